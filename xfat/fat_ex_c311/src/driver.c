@@ -4,10 +4,20 @@
  * γַhttp://01ketang.cc
  * ȨԴǿԴοǰϵߡ
  */
+#ifndef _WIN32
+// ֤off_tΪ64λԱfseekoʳ4GBĴӳ
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+#endif
+
 #include <stdio.h>
 #include <time.h>
 #include "xdisk.h"
 #include "xfat.h"
+#include "driver.h"
+
+u32_t vdisk_sector_size = 512;
 
 /**
  * ʼ豸
@@ -25,10 +35,10 @@ static xfat_err_t xdisk_hw_open(xdisk_t *disk, void * init_data) {
     }
 
     disk->data = file;
-    disk->sector_size = 512;
+    disk->sector_size = vdisk_sector_size;
 
-    fseek(file, 0, SEEK_END);
-    disk->total_sector = ftell(file) / disk->sector_size;
+    vdisk_fseek(file, 0, SEEK_END);
+    disk->total_sector = vdisk_total_sector(vdisk_ftell(file), disk->sector_size);
     return FS_ERR_OK;
 }
 
@@ -53,12 +63,12 @@ static xfat_err_t xdisk_hw_close(xdisk_t * disk) {
  * @return
  */
 static xfat_err_t xdisk_hw_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
-    u32_t offset = start_sector * disk->sector_size;
+    u64_t offset = (u64_t)start_sector * disk->sector_size;
     FILE * file = (FILE *)disk->data;
 
-    int err = fseek(file, offset, SEEK_SET);
+    int err = vdisk_fseek(file, offset, SEEK_SET);
     if (err == -1) {
-        printf("seek disk failed:0x%x\n", (int)offset);
+        printf("seek disk failed:0x%llx\n", (unsigned long long)offset);
         return FS_ERR_IO;
     }
 
@@ -79,12 +89,12 @@ static xfat_err_t xdisk_hw_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_
  * @return
  */
 static xfat_err_t xdisk_hw_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
-    u32_t offset = start_sector * disk->sector_size;
+    u64_t offset = (u64_t)start_sector * disk->sector_size;
     FILE * file = (FILE *)disk->data;
 
-    int err = fseek(file, offset, SEEK_SET);
+    int err = vdisk_fseek(file, offset, SEEK_SET);
     if (err == -1) {
-        printf("seek disk failed: 0x%x\n", (int)offset);
+        printf("seek disk failed: 0x%llx\n", (unsigned long long)offset);
         return FS_ERR_IO;
     }
 
@@ -104,7 +114,7 @@ static xfat_err_t xdisk_hw_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start
  * @param timeinfo ʱ洢
  * @return
  */
-static xfat_err_t xdisk_hw_curr_time(xdisk_t *disk, xfile_time_t *timeinfo) {
+xfat_err_t xdisk_hw_curr_time(xdisk_t *disk, xfile_time_t *timeinfo) {
     time_t raw_time;
     struct tm * local_time;
 
@@ -0,0 +1,193 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "xdisk.h"
+
+// ӳļֽΪ32λ޷
+#define vdisk_total_sector(size, sector_size)   \
+    ((u32_t)((((u64_t)(size) / (sector_size)) > 0xFFFFFFFFu) ? 0xFFFFFFFFu : ((u64_t)(size) / (sector_size))))
+
+// 64λļλfseek/ftellƫΪlongWindows32λƽֻ̨32λ
+// Windowsƽ̨ϣʹڰstdio.hǰ_FILE_OFFSET_BITSΪ64
+#ifdef _WIN32
+#define vdisk_fseek(file, offset, origin)   _fseeki64((file), (__int64)(offset), (origin))
+#define vdisk_ftell(file)                   ((u64_t)_ftelli64(file))
+#else
+#define vdisk_fseek(file, offset, origin)   fseeko((file), (off_t)(offset), (origin))
+#define vdisk_ftell(file)                   ((u64_t)ftello(file))
+#endif
+
+/**
+ * ڴ̵ĲΪxdisk_openinit_data
+ * ͬһɱͬʱ򿪣ͬһڴ棬һرʱͷ
+ */
+typedef struct _vdisk_ram_t {
+    const char * path;              // ʱĴӳΪ0ʱȫ0Ĵ
+    u64_t size;                     // pathΪ0ʱ̵ֽ
+    u8_t save;                      // ͬرʱǷ޸Ĺдpath
+    void * priv;                    // ڲʹãʼΪ0
+}vdisk_ram_t;
+
+/**
+ * 豸ģ͵ʱģSDeMMCȴ洢豸ķʱ
+ */
+typedef struct _vdisk_model_cfg_t {
+    u32_t cmd_us;                   // ÿдĹ̶΢
+    u32_t read_kbps;                // KB/s0ʾƴʱ
+    u32_t write_kbps;               // дKB/s0ʾƴʱ
+    u32_t erase_block_size;         // ֽ0ʾģ
+    u32_t erase_us;                 // һʱ䣬΢
+    u8_t realtime;                  // Ƿģʱʵʱ
+}vdisk_model_cfg_t;
+
+/**
+ * 豸ģ͵ͳϢ
+ */
+typedef struct _vdisk_model_stat_t {
+    u64_t time_ns;                  // ģ豸ۼƺʱ
+    u32_t read_count;               // 
+    u32_t write_count;              // д
+    u64_t read_bytes;               // ȡֽ
+    u64_t write_bytes;              // дֽ
+    u32_t erase_count;              // Ĵ
+    u32_t rmw_count;                // --дĴ
+    u64_t rmw_bytes;                // --джƵֽ
+}vdisk_model_stat_t;
+
+/**
+ * 豸ģĲΪxdisk_openinit_data
+ * ʱstat0֮ʱȡ
+ */
+typedef struct _vdisk_model_t {
+    xdisk_driver_t * driver;        // װ
+    void * init_data;               // װinit_data
+    vdisk_model_cfg_t cfg;          // ʱ
+    vdisk_model_stat_t stat;        // ͳϢ
+
+    void * inner_data;              // ڲʹ
+    u64_t open_block;               // ǰ˳дĲ
+    u64_t open_offset;              // ÿһ˳дλ
+    u8_t block_open;                // Ƿп˳дĲ
+    u64_t sleep_debt_ns;            // ʵʱģʽδʱʱ
+}vdisk_model_t;
+
+#define VDISK_TRACE_MAGIC       0x43525458      // ļıʶ"XTRC"
+#define VDISK_TRACE_VERSION     1               // ļĸʽ汾
+#define VDISK_TRACE_BUF_NR      256             // дļǰļ¼
+
+/**
+ * ټ¼Ĳ
+ */
+typedef enum _vdisk_trace_op_t {
+    VDISK_TRACE_READ = 0,           // ɢҲΪһ
+    VDISK_TRACE_WRITE = 1,          // дۼдҲΪһ
+    VDISK_TRACE_ZEROES = 2,         // 0
+    VDISK_TRACE_DISCARD = 3,        // ֪ͨʹ
+    VDISK_TRACE_SYNC = 4,           // ͬżΪ0
+}vdisk_trace_op_t;
+
+#pragma pack(1)
+
+/**
+ * ļͷΪĸټ¼С˴洢
+ */
+typedef struct _vdisk_trace_hdr_t {
+    u32_t magic;                    // VDISK_TRACE_MAGIC
+    u16_t version;                  // VDISK_TRACE_VERSION
+    u16_t rec_size;                 // ÿ¼ֽ
+    u32_t sector_size;              // ٴ̵С
+    u32_t total_sector;             // ٴ̵
+}vdisk_trace_hdr_t;
+
+/**
+ * ټ¼
+ */
+typedef struct _vdisk_trace_rec_t {
+    u8_t op;                        // ͣvdisk_trace_op_t
+    u32_t start_sector;             // ʼ
+    u32_t count;                    // 
+    u32_t delta_us;                 // һ¼ʱ䣬΢룬Ϊ򿪴̵ʱ
+}vdisk_trace_rec_t;
+
+#pragma pack()
+
+/**
+ * ټطŵͳϢ
+ */
+typedef struct _vdisk_trace_stat_t {
+    u32_t read_count;               // 
+    u32_t write_count;              // д0
+    u64_t read_sectors;             // ȡ
+    u64_t write_sectors;            // д0
+    u32_t other_count;              // 
+}vdisk_trace_stat_t;
+
+/**
+ * ĲΪxdisk_openinit_data
+ * ʱpathָĸļرʱд겢رգstatʱȡ
+ */
+typedef struct _vdisk_trace_t {
+    xdisk_driver_t * driver;        // װ
+    void * init_data;               // װinit_data
+    const char * path;              // ļ·
+    vdisk_trace_stat_t stat;        // ͳϢ
+
+    void * inner_data;              // ڲʹ
+    void * file;                    // ļ
+    u64_t last_us;                  // һ¼ʱ
+    xfat_err_t err;                 // дļʱֵ׸
+    u32_t rec_count;                // bufлļ¼
+    vdisk_trace_rec_t buf[VDISK_TRACE_BUF_NR];
+}vdisk_trace_t;
+
+// stdioƽ̨ͨ
+extern xdisk_driver_t vdisk_driver;
+
+// ӳļСȱʡΪ512xdisk_openǰ޸ģ4K(4Kn)Ĵ
+// 豸ʹøֵѯ豸ʵʵ߼С
+extern u32_t vdisk_sector_size;
+
+// ȫڴеڴɴӳ뼰дأƽ̨ͨ
+extern xdisk_driver_t vdisk_ram_driver;
+
+// װ豸ģͼ㲢ۼƷʱ䣬ƽ̨ͨ
+extern xdisk_driver_t vdisk_model_driver;
+
+// SDeMMCĵʱ
+extern const vdisk_model_cfg_t vdisk_model_sd;
+extern const vdisk_model_cfg_t vdisk_model_emmc;
+
+// װÿηʼ¼ļƽ̨ͨ
+extern xdisk_driver_t vdisk_trace_driver;
+
+// ļеķڴִУдΪbufferе
+xfat_err_t vdisk_trace_replay(xdisk_t * disk, const char * path, u8_t * buffer, u32_t buf_size, vdisk_trace_stat_t * stat);
+
+#ifndef _WIN32
+// ļpread/pwritePOSIXƽ̨
+extern xdisk_driver_t vdisk_fd_driver;
+
+// ѯӳļ豸СֽPOSIXʹ
+xfat_err_t xdisk_fd_geometry(int fd, u32_t * sector_size, u64_t * size);
+
+// ӳӳ䵽ڴֱӳPOSIXƽ̨
+extern xdisk_driver_t vdisk_mmap_driver;
+#endif
+
+#ifdef __linux__
+// io_uring첽ͬʱύд󣬽Linux
+extern xdisk_driver_t vdisk_uring_driver;
+
+// O_DIRECTӳƹҳĻתдLinux
+extern xdisk_driver_t vdisk_direct_driver;
+#endif
+
+xfat_err_t xdisk_hw_curr_time(xdisk_t *disk, struct _xfile_time_t *timeinfo);
+
+#endif
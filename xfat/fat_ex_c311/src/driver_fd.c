@@ -0,0 +1,688 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#ifndef _WIN32
+
+// ֤off_tΪ64λԱʳ2GBĴӳ
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+// fallocateFALLOC_FL_*O_DIRECTҪ
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+/**
+ * ȡ̶Ӧļ
+ */
+#define disk_fd(disk)       ((int)(intptr_t)(disk)->data)
+
+#define FD_IOV_MAX          64              // preadv/pwritev
+
+/**
+ * ļָλöд
+ * pread/pwriteֻ䲿ݻźжϣѭֱ
+ * @param fd ļ
+ * @param buffer ݻ
+ * @param offset ļеʼλ
+ * @param size дֽ
+ * @param is_write ǷΪд
+ * @return
+ */
+static xfat_err_t fd_rw(int fd, u8_t *buffer, off_t offset, size_t size, int is_write) {
+    while (size > 0) {
+        ssize_t n = is_write ? pwrite(fd, buffer, size, offset) : pread(fd, buffer, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FS_ERR_IO;
+        } else if (n == 0) {
+            // ļĩβ˵ӳС
+            return FS_ERR_IO;
+        }
+
+        buffer += n;
+        offset += n;
+        size -= (size_t)n;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ɢۼдζӦļ
+ * ÿύFD_IOV_MAXΣʱɵĲּ
+ * @param fd ļ
+ * @param vec λ
+ * @param vec_count 
+ * @param offset ļеʼλ
+ * @param sector_size С
+ * @param is_write ǷΪд
+ * @return
+ */
+static xfat_err_t fd_rw_v(int fd, const xdisk_vec_t *vec, u32_t vec_count, off_t offset, u32_t sector_size, int is_write) {
+    struct iovec iov[FD_IOV_MAX];
+
+    while (vec_count > 0) {
+        u32_t n = (vec_count > FD_IOV_MAX) ? FD_IOV_MAX : vec_count;
+        struct iovec * curr_iov = iov;
+        u32_t left = n, i;
+
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = vec[i].buffer;
+            iov[i].iov_len = (size_t)vec[i].count * sector_size;
+        }
+
+        while (left > 0) {
+            ssize_t size = is_write ? pwritev(fd, curr_iov, (int)left, offset) : preadv(fd, curr_iov, (int)left, offset);
+            if (size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return FS_ERR_IO;
+            } else if (size == 0) {
+                return FS_ERR_IO;
+            }
+
+            offset += size;
+            while ((left > 0) && ((size_t)size >= curr_iov->iov_len)) {
+                size -= curr_iov->iov_len;
+                curr_iov++;
+                left--;
+            }
+            if (left > 0) {
+                curr_iov->iov_base = (u8_t *)curr_iov->iov_base + size;
+                curr_iov->iov_len -= (size_t)size;
+            }
+        }
+
+        vec += n;
+        vec_count -= n;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ļдͬ洢
+ * ֻͬݼԪݣȴʱϢ
+ * @param fd ļ
+ * @return
+ */
+static xfat_err_t fd_sync(int fd) {
+    int err;
+
+    do {
+#ifdef __APPLE__
+        err = fsync(fd);
+#else
+        err = fdatasync(fd);
+#endif
+    } while ((err < 0) && (errno == EINTR));
+
+    return (err < 0) ? FS_ERR_IO : FS_ERR_OK;
+}
+
+#ifdef __linux__
+/**
+ * ļеִfallocate
+ * @param fd ļ
+ * @param mode FALLOC_FL_*
+ * @param start_sector ʼ
+ * @param count 
+ * @param sector_size С
+ * @return
+ */
+static xfat_err_t fd_fallocate(int fd, int mode, u32_t start_sector, u32_t count, u32_t sector_size) {
+    off_t offset = (off_t)start_sector * sector_size;
+    off_t size = (off_t)count * sector_size;
+
+    if (fallocate(fd, mode | FALLOC_FL_KEEP_SIZE, offset, size) < 0) {
+        return FS_ERR_IO;
+    }
+    return FS_ERR_OK;
+}
+#endif
+
+/**
+ * ѯӳļ豸Сֽ
+ * ӳļСȡvdisk_sector_size豸st_sizeΪ0ͨioctlѯ߼С
+ * @param fd ļ
+ * @param sector_size صС
+ * @param size صֽ
+ * @return
+ */
+xfat_err_t xdisk_fd_geometry(int fd, u32_t * sector_size, u64_t * size) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        return FS_ERR_IO;
+    }
+
+    *sector_size = vdisk_sector_size;
+    *size = (u64_t)st.st_size;
+
+#ifdef __linux__
+    if (S_ISBLK(st.st_mode)) {
+        int logical_size;
+
+        if ((ioctl(fd, BLKSSZGET, &logical_size) < 0) || (ioctl(fd, BLKGETSIZE64, size) < 0)) {
+            return FS_ERR_IO;
+        }
+        *sector_size = (u32_t)logical_size;
+    }
+#endif
+    return FS_ERR_OK;
+}
+
+/**
+ * ӳļȡС
+ * @param disk ʼ豸
+ * @param path ӳļ·
+ * @param flags ӵĴ򿪱־
+ * @param fd صļ
+ * @return
+ */
+static xfat_err_t fd_open_image(xdisk_t *disk, const char *path, int flags, int *fd) {
+    u64_t size;
+
+    *fd = open(path, O_RDWR | flags);
+    if (*fd < 0) {
+        printf("open disk failed:%s\n", path);
+        return FS_ERR_IO;
+    }
+
+    if (xdisk_fd_geometry(*fd, &disk->sector_size, &size) < 0) {
+        printf("stat disk failed:%s\n", path);
+        close(*fd);
+        return FS_ERR_IO;
+    }
+
+    disk->total_sector = vdisk_total_sector(size, disk->sector_size);
+    return FS_ERR_OK;
+}
+
+/**
+ * ʼ豸
+ * vdisk_driverͬдֱͨpread/pwriteУstdio壬
+ * дҲÿͬҪʱϲxdisk_sync
+ * @param disk ʼ豸
+ * @param init_data ӳļ·
+ * @return
+ */
+static xfat_err_t xdisk_fd_open(xdisk_t *disk, void * init_data) {
+    xfat_err_t err;
+    int fd;
+
+    err = fd_open_image(disk, (const char *)init_data, 0, &fd);
+    if (err < 0) {
+        return err;
+    }
+
+    disk->data = (void *)(intptr_t)fd;
+    return FS_ERR_OK;
+}
+
+/**
+ * رմ洢豸
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_fd_close(xdisk_t * disk) {
+    if (close(disk_fd(disk)) < 0) {
+        return FS_ERR_IO;
+    }
+
+    return FS_ERR_OK;
+}
+
+/**
+ * 豸жȡָ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_fd_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err;
+
+    err = fd_rw(disk_fd(disk), buffer, (off_t)start_sector * disk->sector_size, (size_t)count * disk->sector_size, 0);
+    if (err < 0) {
+        printf("read disk failed:sector:%d, count:%d\n", (int)start_sector, (int)count);
+    }
+    return err;
+}
+
+/**
+ * 豸дָ
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_fd_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err;
+
+    err = fd_rw(disk_fd(disk), buffer, (off_t)start_sector * disk->sector_size, (size_t)count * disk->sector_size, 1);
+    if (err < 0) {
+        printf("write disk failed:sector:%d, count:%d\n", (int)start_sector, (int)count);
+    }
+    return err;
+}
+
+/**
+ * жȡݣδ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+static xfat_err_t xdisk_fd_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    xfat_err_t err;
+
+    err = fd_rw_v(disk_fd(disk), vec, vec_count, (off_t)start_sector * disk->sector_size, disk->sector_size, 0);
+    if (err < 0) {
+        printf("read disk failed:sector:%d, count:%d\n", (int)start_sector, (int)vec_count);
+    }
+    return err;
+}
+
+/**
+ * ед
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+static xfat_err_t xdisk_fd_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    xfat_err_t err;
+
+    err = fd_rw_v(disk_fd(disk), vec, vec_count, (off_t)start_sector * disk->sector_size, disk->sector_size, 1);
+    if (err < 0) {
+        printf("write disk failed:sector:%d, count:%d\n", (int)start_sector, (int)vec_count);
+    }
+    return err;
+}
+
+/**
+ * дͬ洢
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_fd_sync(xdisk_t * disk) {
+    return fd_sync(disk_fd(disk));
+}
+
+#ifdef __linux__
+/**
+ * ӳļд򶴣ͷռĴ̿ռ䣬֮ȡõ0
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_fd_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    return fd_fallocate(disk_fd(disk), FALLOC_FL_PUNCH_HOLE, start_sector, count, disk->sector_size);
+}
+
+/**
+ * 0ļϵͳֱɣ贫
+ * ļϵͳ֧ʱشϲͨд
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_fd_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    return fd_fallocate(disk_fd(disk), FALLOC_FL_ZERO_RANGE, start_sector, count, disk->sector_size);
+}
+#endif
+
+/**
+ * ļṹ
+ */
+xdisk_driver_t vdisk_fd_driver = {
+    .open = xdisk_fd_open,
+    .close = xdisk_fd_close,
+    .read_sector = xdisk_fd_read_sector,
+    .write_sector = xdisk_fd_write_sector,
+    .read_sector_v = xdisk_fd_read_sector_v,
+    .write_sector_v = xdisk_fd_write_sector_v,
+    .sync = xdisk_fd_sync,
+#ifdef __linux__
+    .discard = xdisk_fd_discard,
+    .write_zeroes = xdisk_fd_write_zeroes,
+#endif
+    .curr_time = xdisk_hw_curr_time,
+};
+
+#ifdef __linux__
+
+#define DIO_DISK_NR         4               // ͬʱ򿪵O_DIRECT
+#define DIO_BOUNCE_SIZE     (64 * 1024)     // תĴСΪXFAT_BUF_ALIGN
+
+/**
+ * O_DIRECT̵Ϣ
+ */
+typedef struct _dio_t {
+    u8_t bounce[DIO_BOUNCE_SIZE] __attribute__((aligned(XFAT_BUF_ALIGN)));    // ת
+    int fd;                             // O_DIRECT򿪵ļ
+    u32_t mem_align;                    // ַĶҪ
+    u32_t offset_align;                 // ļλüȵĶҪ
+    u8_t is_used;                       // Ƿѱռ
+}dio_t;
+
+static dio_t dio_tbl[DIO_DISK_NR];
+
+/**
+ * ȡ̶ӦO_DIRECTϢ
+ */
+#define disk_dio(disk)      ((dio_t *)(disk)->data)
+
+/**
+ * жϻдǷO_DIRECTĶҪ
+ */
+#define dio_is_aligned(dio, buffer, offset, size)   \
+    ((((size_t)(buffer) & ((dio)->mem_align - 1)) == 0) \
+    && (((size_t)(offset) & ((dio)->offset_align - 1)) == 0) \
+    && (((size_t)(size) & ((dio)->offset_align - 1)) == 0))
+
+/**
+ * ʼO_DIRECT豸дƹϵͳҳ棬ֱӷʴ洢豸
+ * ҪXFAT_BUF_ALIGN룬disk->buf_alignʹ̻水˶
+ * ļλõĶҪļϵͳйأʱԶһȷ
+ * ܰдΪСXFAT_BUF_ALIGN
+ * @param disk ʼ豸
+ * @param init_data ӳļ·
+ * @return
+ */
+static xfat_err_t xdisk_dio_open(xdisk_t *disk, void * init_data) {
+    const char * path = (const char *)init_data;
+    dio_t * dio = (dio_t *)0;
+    xfat_err_t err;
+    int fd, i;
+
+    for (i = 0; i < DIO_DISK_NR; i++) {
+        if (!dio_tbl[i].is_used) {
+            dio = dio_tbl + i;
+            break;
+        }
+    }
+    if (dio == (dio_t *)0) {
+        printf("too many direct disks:%s\n", path);
+        return FS_ERR_NO_BUFFER;
+    }
+
+    err = fd_open_image(disk, path, O_DIRECT, &fd);
+    if (err < 0) {
+        return err;
+    }
+
+    dio->fd = fd;
+    dio->mem_align = XFAT_BUF_ALIGN;
+    dio->offset_align = disk->sector_size;
+    if ((disk->total_sector > 1) && (fd_rw(fd, dio->bounce, disk->sector_size, disk->sector_size, 0) < 0)) {
+        dio->offset_align = XFAT_BUF_ALIGN;
+    }
+
+    // ӳĩβһ뵥λʱ޷O_DIRECT
+    if (((u64_t)disk->total_sector * disk->sector_size) & (dio->offset_align - 1)) {
+        printf("disk size not aligned for O_DIRECT:%s\n", path);
+        close(fd);
+        return FS_ERR_PARAM;
+    }
+
+    dio->is_used = 1;
+    disk->data = dio;
+    disk->buf_align = XFAT_BUF_ALIGN;
+    return FS_ERR_OK;
+}
+
+/**
+ * رմ洢豸
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_dio_close(xdisk_t * disk) {
+    dio_t * dio = disk_dio(disk);
+
+    dio->is_used = 0;
+    if (close(dio->fd) < 0) {
+        return FS_ERR_IO;
+    }
+
+    return FS_ERR_OK;
+}
+
+/**
+ * O_DIRECTʽд
+ * ҪʱֱӶдתֿУ
+ * ÿչ߽磬дʱδȶԭ޸
+ * @param disk дĴ
+ * @param buffer ݻ
+ * @param start_sector ʼ
+ * @param count 
+ * @param is_write ǷΪд
+ * @return
+ */
+static xfat_err_t dio_rw(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count, int is_write) {
+    dio_t * dio = disk_dio(disk);
+    off_t offset = (off_t)start_sector * disk->sector_size;
+    size_t size = (size_t)count * disk->sector_size;
+    xfat_err_t err;
+
+    if (dio_is_aligned(dio, buffer, offset, size)) {
+        return fd_rw(dio->fd, buffer, offset, size, is_write);
+    }
+
+    while (size > 0) {
+        off_t io_offset = offset & ~(off_t)(dio->offset_align - 1);
+        size_t skip = (size_t)(offset - io_offset);
+        size_t copy_size = (size > DIO_BOUNCE_SIZE - skip) ? (DIO_BOUNCE_SIZE - skip) : size;
+        size_t io_size = (skip + copy_size + dio->offset_align - 1) & ~(size_t)(dio->offset_align - 1);
+
+        if (!is_write || (io_size != copy_size)) {
+            err = fd_rw(dio->fd, dio->bounce, io_offset, io_size, 0);
+            if (err < 0) {
+                return err;
+            }
+        }
+
+        if (is_write) {
+            memcpy(dio->bounce + skip, buffer, copy_size);
+            err = fd_rw(dio->fd, dio->bounce, io_offset, io_size, 1);
+            if (err < 0) {
+                return err;
+            }
+        } else {
+            memcpy(buffer, dio->bounce + skip, copy_size);
+        }
+
+        buffer += copy_size;
+        offset += copy_size;
+        size -= copy_size;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ɢۼдξҪʱһύζд
+ * @param disk дĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ʼ
+ * @param is_write ǷΪд
+ * @return
+ */
+static xfat_err_t dio_rw_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector, int is_write) {
+    dio_t * dio = disk_dio(disk);
+    off_t offset = (off_t)start_sector * disk->sector_size;
+    xfat_err_t err;
+    u32_t i;
+
+    for (i = 0; i < vec_count; i++) {
+        if (!dio_is_aligned(dio, vec[i].buffer, offset, (size_t)vec[i].count * disk->sector_size)) {
+            break;
+        }
+    }
+
+    if (i == vec_count) {
+        return fd_rw_v(dio->fd, vec, vec_count, offset, disk->sector_size, is_write);
+    }
+
+    for (i = 0; i < vec_count; i++) {
+        err = dio_rw(disk, vec[i].buffer, start_sector, vec[i].count, is_write);
+        if (err < 0) {
+            return err;
+        }
+        start_sector += vec[i].count;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * 豸жȡָ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļɲ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_dio_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err;
+
+    err = dio_rw(disk, buffer, start_sector, count, 0);
+    if (err < 0) {
+        printf("read disk failed:sector:%d, count:%d\n", (int)start_sector, (int)count);
+    }
+    return err;
+}
+
+/**
+ * 豸дָ
+ * @param disk дĴ洢豸
+ * @param buffer Դɲ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_dio_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err;
+
+    err = dio_rw(disk, buffer, start_sector, count, 1);
+    if (err < 0) {
+        printf("write disk failed:sector:%d, count:%d\n", (int)start_sector, (int)count);
+    }
+    return err;
+}
+
+/**
+ * жȡݣδ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+static xfat_err_t xdisk_dio_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    xfat_err_t err;
+
+    err = dio_rw_v(disk, vec, vec_count, start_sector, 0);
+    if (err < 0) {
+        printf("read disk failed:sector:%d, count:%d\n", (int)start_sector, (int)vec_count);
+    }
+    return err;
+}
+
+/**
+ * ед
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+static xfat_err_t xdisk_dio_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    xfat_err_t err;
+
+    err = dio_rw_v(disk, vec, vec_count, start_sector, 1);
+    if (err < 0) {
+        printf("write disk failed:sector:%d, count:%d\n", (int)start_sector, (int)vec_count);
+    }
+    return err;
+}
+
+/**
+ * ͬ豸д档O_DIRECTҳ棬豸Ļˢ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_dio_sync(xdisk_t * disk) {
+    return fd_sync(disk_dio(disk)->fd);
+}
+
+/**
+ * ӳļд򶴣ͷռĴ̿ռ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_dio_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    return fd_fallocate(disk_dio(disk)->fd, FALLOC_FL_PUNCH_HOLE, start_sector, count, disk->sector_size);
+}
+
+/**
+ * 0ļϵͳ֧ʱϲͨд
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_dio_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    return fd_fallocate(disk_dio(disk)->fd, FALLOC_FL_ZERO_RANGE, start_sector, count, disk->sector_size);
+}
+
+/**
+ * O_DIRECTʽӳļṹڲƹҳʱʵ豸
+ */
+xdisk_driver_t vdisk_direct_driver = {
+    .open = xdisk_dio_open,
+    .close = xdisk_dio_close,
+    .read_sector = xdisk_dio_read_sector,
+    .write_sector = xdisk_dio_write_sector,
+    .read_sector_v = xdisk_dio_read_sector_v,
+    .write_sector_v = xdisk_dio_write_sector_v,
+    .sync = xdisk_dio_sync,
+    .discard = xdisk_dio_discard,
+    .write_zeroes = xdisk_dio_write_zeroes,
+    .curr_time = xdisk_hw_curr_time,
+};
+
+#endif
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#ifndef _WIN32
+
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+/**
+ * ȡӳеĵַ
+ */
+#define disk_addr(disk, sector)     ((u8_t *)(disk)->data + (size_t)(sector) * (disk)->sector_size)
+
+/**
+ * ʼ豸ӳӳ䵽ڴ
+ * ӳ̵ĵַռ
+ * @param disk ʼ豸
+ * @param init_data ӳļ·
+ * @return
+ */
+static xfat_err_t xdisk_mmap_open(xdisk_t *disk, void * init_data) {
+    const char * path = (const char *)init_data;
+    u64_t size;
+    void * addr;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        printf("open disk failed:%s\n", path);
+        return FS_ERR_IO;
+    }
+
+    if ((xdisk_fd_geometry(fd, &disk->sector_size, &size) < 0) || (size == 0) || (size != (size_t)size)) {
+        printf("disk too large or empty:%s\n", path);
+        close(fd);
+        return FS_ERR_IO;
+    }
+
+    // ӳ佨󼴲Ҫļ
+    addr = mmap((void *)0, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        printf("map disk failed:%s\n", path);
+        return FS_ERR_IO;
+    }
+
+    disk->data = addr;
+    disk->total_sector = vdisk_total_sector(size, disk->sector_size);
+    return FS_ERR_OK;
+}
+
+/**
+ * رմ洢豸ӳ֮ʧЧ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_mmap_close(xdisk_t * disk) {
+    if (munmap(disk->data, (size_t)disk->total_sector * disk->sector_size) < 0) {
+        return FS_ERR_IO;
+    }
+
+    return FS_ERR_OK;
+}
+
+/**
+ * 豸жȡָ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_mmap_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    u8_t * addr = disk_addr(disk, start_sector);
+
+    if (buffer != addr) {
+        memcpy(buffer, addr, (size_t)count * disk->sector_size);
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * 豸дָ
+ * дӳõĻʱӳУ追
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_mmap_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    u8_t * addr = disk_addr(disk, start_sector);
+
+    if (buffer != addr) {
+        memcpy(addr, buffer, (size_t)count * disk->sector_size);
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ӳб޸ĵͬдشӳ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_mmap_sync(xdisk_t * disk) {
+    if (msync(disk->data, (size_t)disk->total_sector * disk->sector_size, MS_SYNC) < 0) {
+        return FS_ERR_IO;
+    }
+
+    return FS_ERR_OK;
+}
+
+/**
+ * 0ֱӳ0
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_mmap_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    memset(disk_addr(disk, start_sector), 0, (size_t)count * disk->sector_size);
+    return FS_ERR_OK;
+}
+
+#ifdef MADV_REMOVE
+/**
+ * ͷռĴ̿ռ䣬Թļӳ䣬MADV_REMOVE൱ļд
+ * ֻҳΪλͷţֻΧڵҳ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_mmap_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)disk_addr(disk, start_sector);
+    uintptr_t end = (uintptr_t)disk_addr(disk, start_sector + count);
+
+    start = (start + page_size - 1) & ~(page_size - 1);
+    end &= ~(page_size - 1);
+    if (start >= end) {
+        return FS_ERR_OK;
+    }
+
+    if (madvise((void *)start, end - start, MADV_REMOVE) < 0) {
+        return FS_ERR_IO;
+    }
+    return FS_ERR_OK;
+}
+#endif
+
+/**
+ * ӳָӳӳ䣬ֱӷضӦַ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @param addr ӳõĵַ
+ * @return
+ */
+static xfat_err_t xdisk_mmap_map_sector(xdisk_t *disk, u32_t start_sector, u32_t count, u8_t ** addr) {
+    *addr = disk_addr(disk, start_sector);
+    return FS_ERR_OK;
+}
+
+/**
+ * ڴӳṹ
+ * ӳڹرʱͳһԲҪunmap_sector
+ */
+xdisk_driver_t vdisk_mmap_driver = {
+    .open = xdisk_mmap_open,
+    .close = xdisk_mmap_close,
+    .read_sector = xdisk_mmap_read_sector,
+    .write_sector = xdisk_mmap_write_sector,
+    .sync = xdisk_mmap_sync,
+    .write_zeroes = xdisk_mmap_write_zeroes,
+#ifdef MADV_REMOVE
+    .discard = xdisk_mmap_discard,
+#endif
+    .map_sector = xdisk_mmap_map_sector,
+    .curr_time = xdisk_hw_curr_time,
+};
+
+#endif
@@ -0,0 +1,378 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+/**
+ * SDĵͲ󣬲Ԫ(AU)Ϊ4MBСдۺܸ
+ */
+const vdisk_model_cfg_t vdisk_model_sd = {
+    .cmd_us = 250,
+    .read_kbps = 20 * 1024,
+    .write_kbps = 10 * 1024,
+    .erase_block_size = 4 * 1024 * 1024,
+    .erase_us = 5000,
+    .realtime = 0,
+};
+
+/**
+ * eMMCĵͲ鶼SDС
+ */
+const vdisk_model_cfg_t vdisk_model_emmc = {
+    .cmd_us = 60,
+    .read_kbps = 150 * 1024,
+    .write_kbps = 40 * 1024,
+    .erase_block_size = 512 * 1024,
+    .erase_us = 1500,
+    .realtime = 0,
+};
+
+/**
+ * ȡ̶Ӧģ
+ */
+#define disk_model(disk)        ((vdisk_model_t *)(disk)->data)
+
+/**
+ * ñװʱ豸
+ */
+#define model_call(disk, model, call)   \
+    ((disk)->data = (model)->inner_data, err = (call), (disk)->data = (model), err)
+
+/**
+ * ָʱ
+ * @param bytes ֽ
+ * @param kbps KB/s0ʾƴʱ
+ * @return 
+ */
+static u64_t model_xfer_ns(u64_t bytes, u32_t kbps) {
+    if (kbps == 0) {
+        return 0;
+    }
+    return bytes * 1000000000ull / ((u64_t)kbps * 1024);
+}
+
+/**
+ * ۼģʱ䣬ʵʱģʽͬʱõߵȴӦʱ
+ * @param model 豸ģ
+ * @param ns ʱ
+ */
+static void model_charge(vdisk_model_t * model, u64_t ns) {
+    model->stat.time_ns += ns;
+    if (!model->cfg.realtime) {
+        return;
+    }
+
+#ifdef _WIN32
+    // SleepľΪ룬1msĲۻһ
+    model->sleep_debt_ns += ns;
+    if (model->sleep_debt_ns >= 1000000) {
+        Sleep((DWORD)(model->sleep_debt_ns / 1000000));
+        model->sleep_debt_ns %= 1000000;
+    }
+#else
+    {
+        struct timespec ts;
+
+        ts.tv_sec = (time_t)(ns / 1000000000ull);
+        ts.tv_nsec = (long)(ns % 1000000000ull);
+        while (nanosleep(&ts, &ts) < 0) {}
+    }
+#endif
+}
+
+/**
+ * ͳƷɢ/ۼд
+ * @param vec
+ * @param vec_count
+ * @return
+ */
+static u32_t model_vec_sectors(const xdisk_vec_t *vec, u32_t vec_count) {
+    u32_t count = 0;
+
+    while (vec_count--) {
+        count += vec++->count;
+    }
+    return count;
+}
+
+/**
+ * дĴ
+ * 豸ԲΪλдֻһ򿪵Ŀɱ˳д룺
+ * ӿʼд¿ʱֻȲдλòǴ򿪿һʱ
+ * 轫ݶһдأ--д
+ * @param disk
+ * @param model 豸ģ
+ * @param start_sector дʼ
+ * @param count 
+ * @return 
+ */
+static u64_t model_write_ns(xdisk_t * disk, vdisk_model_t * model, u32_t start_sector, u32_t count) {
+    vdisk_model_cfg_t * cfg = &model->cfg;
+    u64_t start = (u64_t)start_sector * disk->sector_size;
+    u64_t end = start + (u64_t)count * disk->sector_size;
+    u64_t ns = model_xfer_ns(end - start, cfg->write_kbps);
+
+    if (cfg->erase_block_size == 0) {
+        return ns;
+    }
+
+    while (start < end) {
+        u64_t block = start / cfg->erase_block_size;
+        u64_t offset = start % cfg->erase_block_size;
+        u64_t size = cfg->erase_block_size - offset;
+
+        size = (size > end - start) ? (end - start) : size;
+        if (!model->block_open || (block != model->open_block) || (offset != model->open_offset)) {
+            model->stat.erase_count++;
+            ns += (u64_t)cfg->erase_us * 1000;
+
+            // δд븲ǵҪ
+            if ((offset != 0) || (size != cfg->erase_block_size)) {
+                u64_t copy = cfg->erase_block_size - size;
+
+                model->stat.rmw_count++;
+                model->stat.rmw_bytes += copy;
+                ns += model_xfer_ns(copy, cfg->read_kbps) + model_xfer_ns(copy, cfg->write_kbps);
+            }
+        }
+
+        model->block_open = 1;
+        model->open_block = block;
+        model->open_offset = offset + size;
+        if (model->open_offset == cfg->erase_block_size) {
+            model->block_open = 0;
+        }
+        start += size;
+    }
+    return ns;
+}
+
+/**
+ * 򿪱װ豸֮disk->dataָģͣװĲб
+ * СҪñװ
+ * @param disk ʼ豸
+ * @param init_data 豸ģvdisk_model_tdriverinit_data
+ * @return
+ */
+static xfat_err_t xdisk_model_open(xdisk_t *disk, void * init_data) {
+    vdisk_model_t * model = (vdisk_model_t *)init_data;
+    xfat_err_t err;
+
+    err = model->driver->open(disk, model->init_data);
+    if (err < 0) {
+        return err;
+    }
+
+    model->inner_data = disk->data;
+    model->block_open = 0;
+    model->sleep_debt_ns = 0;
+    memset(&model->stat, 0, sizeof(model->stat));
+    disk->data = model;
+    return FS_ERR_OK;
+}
+
+/**
+ * رձװ豸
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_model_close(xdisk_t * disk) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    return model_call(disk, model, model->driver->close(disk));
+}
+
+/**
+ * ȡһʱ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_model_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    vdisk_model_t * model = disk_model(disk);
+    u64_t bytes = (u64_t)count * disk->sector_size;
+    xfat_err_t err;
+
+    model->stat.read_count++;
+    model->stat.read_bytes += bytes;
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000 + model_xfer_ns(bytes, model->cfg.read_kbps));
+    return model_call(disk, model, model->driver->read_sector(disk, buffer, start_sector, count));
+}
+
+/**
+ * дһʱ估Ĵ
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_model_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    model->stat.write_count++;
+    model->stat.write_bytes += (u64_t)count * disk->sector_size;
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000 + model_write_ns(disk, model, start_sector, count));
+    return model_call(disk, model, model->driver->write_sector(disk, buffer, start_sector, count));
+}
+
+/**
+ * ɢֻһװ֧ʱζȡ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+static xfat_err_t xdisk_model_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    vdisk_model_t * model = disk_model(disk);
+    u64_t bytes = (u64_t)model_vec_sectors(vec, vec_count) * disk->sector_size;
+    xfat_err_t err = FS_ERR_OK;
+
+    model->stat.read_count++;
+    model->stat.read_bytes += bytes;
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000 + model_xfer_ns(bytes, model->cfg.read_kbps));
+
+    if (model->driver->read_sector_v) {
+        return model_call(disk, model, model->driver->read_sector_v(disk, vec, vec_count, start_sector));
+    }
+
+    for (; (vec_count > 0) && (err >= 0); vec_count--, vec++) {
+        err = model_call(disk, model, model->driver->read_sector(disk, vec->buffer, start_sector, vec->count));
+        start_sector += vec->count;
+    }
+    return err;
+}
+
+/**
+ * ۼдֻһװ֧ʱд
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+static xfat_err_t xdisk_model_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    vdisk_model_t * model = disk_model(disk);
+    u32_t count = model_vec_sectors(vec, vec_count);
+    xfat_err_t err = FS_ERR_OK;
+
+    model->stat.write_count++;
+    model->stat.write_bytes += (u64_t)count * disk->sector_size;
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000 + model_write_ns(disk, model, start_sector, count));
+
+    if (model->driver->write_sector_v) {
+        return model_call(disk, model, model->driver->write_sector_v(disk, vec, vec_count, start_sector));
+    }
+
+    for (; (vec_count > 0) && (err >= 0); vec_count--, vec++) {
+        err = model_call(disk, model, model->driver->write_sector(disk, vec->buffer, start_sector, vec->count));
+        start_sector += vec->count;
+    }
+    return err;
+}
+
+/**
+ * ͬ൱豸Ļˢ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_model_sync(xdisk_t * disk) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000);
+    if (model->driver->sync == 0) {
+        return FS_ERR_OK;
+    }
+    return model_call(disk, model, model->driver->sync(disk));
+}
+
+/**
+ * ֪ͨ豸ʹãװ֧ʱֻһ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_model_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    if (model->driver->discard == 0) {
+        return FS_ERR_OK;
+    }
+
+    model_charge(model, (u64_t)model->cfg.cmd_us * 1000);
+    return model_call(disk, model, model->driver->discard(disk, start_sector, count));
+}
+
+/**
+ * 0װ֧ʱһдƣϲΪͨдֱ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_model_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    if (model->driver->write_zeroes == 0) {
+        return FS_ERR_PARAM;
+    }
+
+    err = model_call(disk, model, model->driver->write_zeroes(disk, start_sector, count));
+    if (err >= 0) {
+        model->stat.write_count++;
+        model_charge(model, (u64_t)model->cfg.cmd_us * 1000 + model_write_ns(disk, model, start_sector, count));
+    }
+    return err;
+}
+
+/**
+ * ȡǰʱ
+ * @param disk
+ * @param timeinfo ʱ洢
+ * @return
+ */
+static xfat_err_t xdisk_model_curr_time(xdisk_t * disk, xfile_time_t * timeinfo) {
+    vdisk_model_t * model = disk_model(disk);
+    xfat_err_t err;
+
+    return model_call(disk, model, model->driver->curr_time(disk, timeinfo));
+}
+
+/**
+ * 豸ģṹ
+ * ṩӳ估첽ӿڣ֤зʶģͼʱ
+ * ʼṩdiscardװ֧ʱԣϲ˻ᶪͷŴڻе
+ */
+xdisk_driver_t vdisk_model_driver = {
+    .open = xdisk_model_open,
+    .close = xdisk_model_close,
+    .read_sector = xdisk_model_read_sector,
+    .write_sector = xdisk_model_write_sector,
+    .read_sector_v = xdisk_model_read_sector_v,
+    .write_sector_v = xdisk_model_write_sector_v,
+    .sync = xdisk_model_sync,
+    .discard = xdisk_model_discard,
+    .write_zeroes = xdisk_model_write_zeroes,
+    .curr_time = xdisk_model_curr_time,
+};
@@ -0,0 +1,410 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#ifndef _WIN32
+// ֤off_tΪ64λԱ뼰дس4GBĴӳ
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+// MAP_ANONYMOUSMAP_HUGETLBMADV_HUGEPAGEҪ
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+#define RAM_HUGE_PAGE_SIZE      (2 * 1024 * 1024)       // ҳĴСڴ̰ȡʹôҳ
+#define RAM_FILE_IO_SIZE        (64 * 1024 * 1024)      // 뼰дӳʱζдֽ
+
+/**
+ * дɲУд0дӳʱռ
+ */
+#ifdef _WIN32
+typedef SRWLOCK ram_lock_t;
+#define ram_lock_init(lock)         InitializeSRWLock(lock)
+#define ram_lock_destroy(lock)
+#define ram_read_lock(lock)         AcquireSRWLockShared(lock)
+#define ram_read_unlock(lock)       ReleaseSRWLockShared(lock)
+#define ram_write_lock(lock)        AcquireSRWLockExclusive(lock)
+#define ram_write_unlock(lock)      ReleaseSRWLockExclusive(lock)
+#else
+typedef pthread_rwlock_t ram_lock_t;
+#define ram_lock_init(lock)         pthread_rwlock_init((lock), (pthread_rwlockattr_t *)0)
+#define ram_lock_destroy(lock)      pthread_rwlock_destroy(lock)
+#define ram_read_lock(lock)         pthread_rwlock_rdlock(lock)
+#define ram_read_unlock(lock)       pthread_rwlock_unlock(lock)
+#define ram_write_lock(lock)        pthread_rwlock_wrlock(lock)
+#define ram_write_unlock(lock)      pthread_rwlock_unlock(lock)
+#endif
+
+/**
+ * ڴ̣vdisk_ram_tprivã򿪸òĸ̹
+ */
+typedef struct _ram_disk_t {
+    u8_t * mem;                     // 
+    size_t mem_size;                // ڴСܴڴ
+    u64_t size;                     // ̵ֽ
+    u32_t ref;                      // 򿪵Ĵ
+    ram_lock_t lock;
+
+    u64_t dirty_start;              // δдӳֽڷΧʼڽʾ
+    u64_t dirty_end;
+}ram_disk_t;
+
+/**
+ * ȡ̶Ӧڴ
+ */
+#define disk_ram(disk)              ((ram_disk_t *)((vdisk_ram_t *)(disk)->data)->priv)
+
+/**
+ * ȡڴеĵַ
+ */
+#define disk_addr(disk, sector)     (disk_ram(disk)->mem + (size_t)(sector) * (disk)->sector_size)
+
+/**
+ * ڴ̵Ĵ洢ȫΪ0
+ * LinuxȳԴҳԼTLBȱʧϵͳδԤҳʱͨҳںʹ͸ҳ
+ * @param ram ڴ
+ * @return
+ */
+static xfat_err_t ram_alloc(ram_disk_t * ram) {
+    ram->mem_size = (size_t)ram->size;
+
+#ifdef _WIN32
+    ram->mem = (u8_t *)VirtualAlloc(NULL, ram->mem_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (ram->mem == NULL) {
+        return FS_ERR_NO_BUFFER;
+    }
+#else
+    {
+        void * addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        size_t huge_size = (ram->mem_size + RAM_HUGE_PAGE_SIZE - 1) & ~(size_t)(RAM_HUGE_PAGE_SIZE - 1);
+
+        addr = mmap((void *)0, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            ram->mem_size = huge_size;
+        }
+#endif
+        if (addr == MAP_FAILED) {
+            addr = mmap((void *)0, ram->mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) {
+                return FS_ERR_NO_BUFFER;
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(addr, ram->mem_size, MADV_HUGEPAGE);
+#endif
+        }
+        ram->mem = (u8_t *)addr;
+    }
+#endif
+    return FS_ERR_OK;
+}
+
+/**
+ * ͷڴ̵Ĵ洢
+ * @param ram ڴ
+ */
+static void ram_free(ram_disk_t * ram) {
+#ifdef _WIN32
+    VirtualFree(ram->mem, 0, MEM_RELEASE);
+#else
+    munmap(ram->mem, ram->mem_size);
+#endif
+}
+
+/**
+ * ӳļڴ֮䴫ָΧ
+ * @param ram ڴ
+ * @param file ӳļ
+ * @param start ʼֽ
+ * @param end ֽڣ
+ * @param is_write ǷΪдӳ
+ * @return
+ */
+static xfat_err_t ram_file_io(ram_disk_t * ram, FILE * file, u64_t start, u64_t end, int is_write) {
+    if (vdisk_fseek(file, start, SEEK_SET) != 0) {
+        return FS_ERR_IO;
+    }
+
+    while (start < end) {
+        size_t size = (end - start > RAM_FILE_IO_SIZE) ? RAM_FILE_IO_SIZE : (size_t)(end - start);
+        size_t n = is_write ? fwrite(ram->mem + start, 1, size, file) : fread(ram->mem + start, 1, size, file);
+        if (n != size) {
+            return FS_ERR_IO;
+        }
+        start += size;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ޸ĹķΧдӳļ
+ * @param param ڴ̲
+ * @return
+ */
+static xfat_err_t ram_save(vdisk_ram_t * param) {
+    ram_disk_t * ram = (ram_disk_t *)param->priv;
+    xfat_err_t err = FS_ERR_OK;
+    FILE * file;
+
+    if (!param->save || (param->path == (const char *)0)) {
+        return FS_ERR_OK;
+    }
+
+    ram_write_lock(&ram->lock);
+    if (ram->dirty_start < ram->dirty_end) {
+        file = fopen(param->path, "rb+");
+        if (file == NULL) {
+            err = FS_ERR_IO;
+        } else {
+            err = ram_file_io(ram, file, ram->dirty_start, ram->dirty_end, 1);
+            if (fclose(file) != 0) {
+                err = FS_ERR_IO;
+            }
+        }
+
+        if (err == FS_ERR_OK) {
+            ram->dirty_start = ram->dirty_end = 0;
+        } else {
+            printf("save ram disk failed:%s\n", param->path);
+        }
+    }
+    ram_write_unlock(&ram->lock);
+    return err;
+}
+
+/**
+ * ¼޸ĵķΧʱд
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ */
+static void ram_set_dirty(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    ram_disk_t * ram = disk_ram(disk);
+    u64_t start = (u64_t)start_sector * disk->sector_size;
+    u64_t end = start + (u64_t)count * disk->sector_size;
+
+    if (ram->dirty_start == ram->dirty_end) {
+        ram->dirty_start = start;
+        ram->dirty_end = end;
+    } else {
+        ram->dirty_start = (start < ram->dirty_start) ? start : ram->dirty_start;
+        ram->dirty_end = (end > ram->dirty_end) ? end : ram->dirty_end;
+    }
+}
+
+/**
+ * ʼڴ
+ * ״αʱڴ棬ӳȫݣ֮ٴʱеڴ
+ * ״δ򿪼һιرղ̶߳ͬһĴ򿪡رͬʱ
+ * @param disk ʼ豸
+ * @param init_data ڴ̲vdisk_ram_t
+ * @return
+ */
+static xfat_err_t xdisk_ram_open(xdisk_t *disk, void * init_data) {
+    vdisk_ram_t * param = (vdisk_ram_t *)init_data;
+    ram_disk_t * ram = (ram_disk_t *)param->priv;
+    xfat_err_t err;
+    FILE * file = NULL;
+
+    disk->data = param;
+    disk->sector_size = vdisk_sector_size;
+
+    if (ram) {
+        ram_write_lock(&ram->lock);
+        ram->ref++;
+        ram_write_unlock(&ram->lock);
+
+        disk->total_sector = vdisk_total_sector(ram->size, disk->sector_size);
+        return FS_ERR_OK;
+    }
+
+    ram = (ram_disk_t *)calloc(1, sizeof(ram_disk_t));
+    if (ram == (ram_disk_t *)0) {
+        return FS_ERR_NO_BUFFER;
+    }
+
+    ram->size = param->size;
+    if (param->path) {
+        file = fopen(param->path, "rb");
+        if (file == NULL) {
+            printf("open disk failed:%s\n", param->path);
+            free(ram);
+            return FS_ERR_IO;
+        }
+
+        vdisk_fseek(file, 0, SEEK_END);
+        ram->size = vdisk_ftell(file);
+    }
+
+    // ̵ܷĵַռ
+    if ((ram->size == 0) || (ram->size != (size_t)ram->size) || (ram_alloc(ram) < 0)) {
+        printf("alloc ram disk failed\n");
+        if (file) {
+            fclose(file);
+        }
+        free(ram);
+        return FS_ERR_NO_BUFFER;
+    }
+
+    if (file) {
+        err = ram_file_io(ram, file, 0, ram->size, 0);
+        fclose(file);
+        if (err < 0) {
+            printf("load disk failed:%s\n", param->path);
+            ram_free(ram);
+            free(ram);
+            return err;
+        }
+    }
+
+    ram_lock_init(&ram->lock);
+    ram->ref = 1;
+    param->priv = ram;
+
+    disk->total_sector = vdisk_total_sector(ram->size, disk->sector_size);
+    return FS_ERR_OK;
+}
+
+/**
+ * رڴ̣һ̹رʱдӳͷڴ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_ram_close(xdisk_t * disk) {
+    vdisk_ram_t * param = (vdisk_ram_t *)disk->data;
+    ram_disk_t * ram = (ram_disk_t *)param->priv;
+    xfat_err_t err;
+    u32_t ref;
+
+    ram_write_lock(&ram->lock);
+    ref = --ram->ref;
+    ram_write_unlock(&ram->lock);
+    if (ref > 0) {
+        return FS_ERR_OK;
+    }
+
+    err = ram_save(param);
+
+    ram_lock_destroy(&ram->lock);
+    ram_free(ram);
+    free(ram);
+    param->priv = (void *)0;
+    return err;
+}
+
+/**
+ * 豸жȡָ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_ram_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    ram_disk_t * ram = disk_ram(disk);
+    u8_t * addr = disk_addr(disk, start_sector);
+
+    if (buffer != addr) {
+        ram_read_lock(&ram->lock);
+        memcpy(buffer, addr, (size_t)count * disk->sector_size);
+        ram_read_unlock(&ram->lock);
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * 豸дָ
+ * дӳõĻʱڴУֻ¼޸ķΧ
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_ram_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    ram_disk_t * ram = disk_ram(disk);
+    u8_t * addr = disk_addr(disk, start_sector);
+
+    ram_write_lock(&ram->lock);
+    if (buffer != addr) {
+        memcpy(addr, buffer, (size_t)count * disk->sector_size);
+    }
+    ram_set_dirty(disk, start_sector, count);
+    ram_write_unlock(&ram->lock);
+    return FS_ERR_OK;
+}
+
+/**
+ * ޸Ĺдӳļδsaveʱ޲
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_ram_sync(xdisk_t * disk) {
+    return ram_save((vdisk_ram_t *)disk->data);
+}
+
+/**
+ * 0
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_ram_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    ram_disk_t * ram = disk_ram(disk);
+
+    ram_write_lock(&ram->lock);
+    memset(disk_addr(disk, start_sector), 0, (size_t)count * disk->sector_size);
+    ram_set_dirty(disk, start_sector, count);
+    ram_write_unlock(&ram->lock);
+    return FS_ERR_OK;
+}
+
+/**
+ * ӳָȫڴУֱӷضӦַ
+ * ӳõĻ鱻ֱ޸ģд̹ڴʱ
+ * ͬһӦͬʱ෽д
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @param addr ӳõĵַ
+ * @return
+ */
+static xfat_err_t xdisk_ram_map_sector(xdisk_t *disk, u32_t start_sector, u32_t count, u8_t ** addr) {
+    *addr = disk_addr(disk, start_sector);
+    return FS_ERR_OK;
+}
+
+/**
+ * ڴṹ
+ * ͷŴʱdiscard0write_zeroes
+ */
+xdisk_driver_t vdisk_ram_driver = {
+    .open = xdisk_ram_open,
+    .close = xdisk_ram_close,
+    .read_sector = xdisk_ram_read_sector,
+    .write_sector = xdisk_ram_write_sector,
+    .sync = xdisk_ram_sync,
+    .write_zeroes = xdisk_ram_write_zeroes,
+    .map_sector = xdisk_ram_map_sector,
+    .curr_time = xdisk_hw_curr_time,
+};
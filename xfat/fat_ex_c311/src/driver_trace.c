@@ -0,0 +1,477 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+#define TRACE_REPLAY_REC_NR     64          // طʱÿδӸļȡļ¼
+
+/**
+ * ȡ̶Ӧĸٲ
+ */
+#define disk_trace(disk)        ((vdisk_trace_t *)(disk)->data)
+
+/**
+ * ñװʱ豸
+ */
+#define trace_call(disk, trace, call)   \
+    ((disk)->data = (trace)->inner_data, err = (call), (disk)->data = (trace), err)
+
+/**
+ * ȡʱ
+ * @return ΢
+ */
+static u64_t trace_now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (u64_t)count.QuadPart / (u64_t)freq.QuadPart * 1000000
+        + (u64_t)count.QuadPart % (u64_t)freq.QuadPart * 1000000 / (u64_t)freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64_t)ts.tv_sec * 1000000 + (u64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * ļ¼дļ
+ * д룬ͬرʱأӰ챻ٴ̵Ķд
+ * @param trace ٲ
+ */
+static void trace_flush(vdisk_trace_t * trace) {
+    FILE * file = (FILE *)trace->file;
+
+    if ((trace->rec_count > 0) && (trace->err >= 0)) {
+        if (fwrite(trace->buf, sizeof(vdisk_trace_rec_t), trace->rec_count, file) != trace->rec_count) {
+            trace->err = FS_ERR_IO;
+        }
+    }
+    trace->rec_count = 0;
+}
+
+/**
+ * һټ¼ͳ
+ * @param trace ٲ
+ * @param op 
+ * @param start_sector ʼ
+ * @param count 
+ */
+static void trace_add(vdisk_trace_t * trace, vdisk_trace_op_t op, u32_t start_sector, u32_t count) {
+    vdisk_trace_rec_t * rec = trace->buf + trace->rec_count;
+    u64_t now = trace_now_us();
+    u64_t delta = now - trace->last_us;
+
+    rec->op = (u8_t)op;
+    rec->start_sector = start_sector;
+    rec->count = count;
+    rec->delta_us = (delta > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (u32_t)delta;
+    trace->last_us = now;
+
+    switch (op) {
+    case VDISK_TRACE_READ:
+        trace->stat.read_count++;
+        trace->stat.read_sectors += count;
+        break;
+    case VDISK_TRACE_WRITE:
+    case VDISK_TRACE_ZEROES:
+        trace->stat.write_count++;
+        trace->stat.write_sectors += count;
+        break;
+    default:
+        trace->stat.other_count++;
+        break;
+    }
+
+    if (++trace->rec_count >= VDISK_TRACE_BUF_NR) {
+        trace_flush(trace);
+    }
+}
+
+/**
+ * ͳƷɢ/ۼд
+ * @param vec
+ * @param vec_count
+ * @return
+ */
+static u32_t trace_vec_sectors(const xdisk_vec_t *vec, u32_t vec_count) {
+    u32_t count = 0;
+
+    while (vec_count--) {
+        count += vec++->count;
+    }
+    return count;
+}
+
+/**
+ * 򿪱װ豸ļ
+ * ֮disk->dataָٲװĲб
+ * @param disk ʼ豸
+ * @param init_data ٲvdisk_trace_tdriverinit_datapath
+ * @return
+ */
+static xfat_err_t xdisk_trace_open(xdisk_t *disk, void * init_data) {
+    vdisk_trace_t * trace = (vdisk_trace_t *)init_data;
+    vdisk_trace_hdr_t hdr;
+    xfat_err_t err;
+    FILE * file;
+
+    file = fopen(trace->path, "wb");
+    if (file == NULL) {
+        printf("open trace file %s failed!\n", trace->path);
+        return FS_ERR_IO;
+    }
+
+    err = trace->driver->open(disk, trace->init_data);
+    if (err < 0) {
+        fclose(file);
+        return err;
+    }
+
+    hdr.magic = VDISK_TRACE_MAGIC;
+    hdr.version = VDISK_TRACE_VERSION;
+    hdr.rec_size = sizeof(vdisk_trace_rec_t);
+    hdr.sector_size = disk->sector_size;
+    hdr.total_sector = disk->total_sector;
+    if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+        printf("write trace file %s failed!\n", trace->path);
+        trace->driver->close(disk);
+        fclose(file);
+        return FS_ERR_IO;
+    }
+
+    trace->inner_data = disk->data;
+    trace->file = file;
+    trace->last_us = trace_now_us();
+    trace->err = FS_ERR_OK;
+    trace->rec_count = 0;
+    memset(&trace->stat, 0, sizeof(trace->stat));
+    disk->data = trace;
+    return FS_ERR_OK;
+}
+
+/**
+ * رձװ豸дļ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_trace_close(xdisk_t * disk) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    FILE * file = (FILE *)trace->file;
+    xfat_err_t err;
+
+    trace_flush(trace);
+    if ((fclose(file) != 0) && (trace->err >= 0)) {
+        trace->err = FS_ERR_IO;
+    }
+
+    err = trace_call(disk, trace, trace->driver->close(disk));
+    return (err < 0) ? err : trace->err;
+}
+
+/**
+ * ȡ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_trace_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err;
+
+    trace_add(trace, VDISK_TRACE_READ, start_sector, count);
+    return trace_call(disk, trace, trace->driver->read_sector(disk, buffer, start_sector, count));
+}
+
+/**
+ * д
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_trace_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err;
+
+    trace_add(trace, VDISK_TRACE_WRITE, start_sector, count);
+    return trace_call(disk, trace, trace->driver->write_sector(disk, buffer, start_sector, count));
+}
+
+/**
+ * ɢΪһζװ֧ʱζȡ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+static xfat_err_t xdisk_trace_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err = FS_ERR_OK;
+
+    trace_add(trace, VDISK_TRACE_READ, start_sector, trace_vec_sectors(vec, vec_count));
+    if (trace->driver->read_sector_v) {
+        return trace_call(disk, trace, trace->driver->read_sector_v(disk, vec, vec_count, start_sector));
+    }
+
+    for (; (vec_count > 0) && (err >= 0); vec_count--, vec++) {
+        err = trace_call(disk, trace, trace->driver->read_sector(disk, vec->buffer, start_sector, vec->count));
+        start_sector += vec->count;
+    }
+    return err;
+}
+
+/**
+ * ۼдΪһдװ֧ʱд
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+static xfat_err_t xdisk_trace_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err = FS_ERR_OK;
+
+    trace_add(trace, VDISK_TRACE_WRITE, start_sector, trace_vec_sectors(vec, vec_count));
+    if (trace->driver->write_sector_v) {
+        return trace_call(disk, trace, trace->driver->write_sector_v(disk, vec, vec_count, start_sector));
+    }
+
+    for (; (vec_count > 0) && (err >= 0); vec_count--, vec++) {
+        err = trace_call(disk, trace, trace->driver->write_sector(disk, vec->buffer, start_sector, vec->count));
+        start_sector += vec->count;
+    }
+    return err;
+}
+
+/**
+ * ͬͬʱļ¼дļ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_trace_sync(xdisk_t * disk) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err = FS_ERR_OK;
+
+    trace_add(trace, VDISK_TRACE_SYNC, 0, 0);
+    if (trace->driver->sync) {
+        err = trace_call(disk, trace, trace->driver->sync(disk));
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    trace_flush(trace);
+    if ((fflush((FILE *)trace->file) != 0) && (trace->err >= 0)) {
+        trace->err = FS_ERR_IO;
+    }
+    return trace->err;
+}
+
+/**
+ * ֪ͨ豸ʹãװ֧ʱ¼
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_trace_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err;
+
+    if (trace->driver->discard == 0) {
+        return FS_ERR_OK;
+    }
+
+    trace_add(trace, VDISK_TRACE_DISCARD, start_sector, count);
+    return trace_call(disk, trace, trace->driver->discard(disk, start_sector, count));
+}
+
+/**
+ * 0װ֧ʱϲΪͨдֱ¼
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_trace_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err;
+
+    if (trace->driver->write_zeroes == 0) {
+        return FS_ERR_PARAM;
+    }
+
+    err = trace_call(disk, trace, trace->driver->write_zeroes(disk, start_sector, count));
+    if (err >= 0) {
+        trace_add(trace, VDISK_TRACE_ZEROES, start_sector, count);
+    }
+    return err;
+}
+
+/**
+ * ȡǰʱ
+ * @param disk
+ * @param timeinfo ʱ洢
+ * @return
+ */
+static xfat_err_t xdisk_trace_curr_time(xdisk_t * disk, xfile_time_t * timeinfo) {
+    vdisk_trace_t * trace = disk_trace(disk);
+    xfat_err_t err;
+
+    return trace_call(disk, trace, trace->driver->curr_time(disk, timeinfo));
+}
+
+/**
+ * ṹ
+ * ṩӳ估첽ӿڣ֤зʶ¼
+ * ʼṩdiscardװ֧ʱԣϲ˻ᶪͷŴڻе
+ */
+xdisk_driver_t vdisk_trace_driver = {
+    .open = xdisk_trace_open,
+    .close = xdisk_trace_close,
+    .read_sector = xdisk_trace_read_sector,
+    .write_sector = xdisk_trace_write_sector,
+    .read_sector_v = xdisk_trace_read_sector_v,
+    .write_sector_v = xdisk_trace_write_sector_v,
+    .sync = xdisk_trace_sync,
+    .discard = xdisk_trace_discard,
+    .write_zeroes = xdisk_trace_write_zeroes,
+    .curr_time = xdisk_trace_curr_time,
+};
+
+/**
+ * طһд¼Сʱִν
+ * @param disk طŵĴ
+ * @param rec ټ¼
+ * @param buffer дõĻ
+ * @param buf_sectors ɵ
+ * @return
+ */
+static xfat_err_t trace_replay_rw(xdisk_t * disk, const vdisk_trace_rec_t * rec, u8_t * buffer, u32_t buf_sectors) {
+    u32_t start_sector = rec->start_sector;
+    u32_t count = rec->count;
+
+    while (count > 0) {
+        u32_t curr_count = (count > buf_sectors) ? buf_sectors : count;
+        xfat_err_t err;
+
+        if (rec->op == VDISK_TRACE_READ) {
+            err = xdisk_read_sector(disk, buffer, start_sector, curr_count);
+        } else {
+            err = xdisk_write_sector(disk, buffer, start_sector, curr_count);
+        }
+        if (err < 0) {
+            return err;
+        }
+
+        start_sector += curr_count;
+        count -= curr_count;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ļеķڴִ
+ * ļݣдbufferеݣԻطŻд̣ڴ̻ӳ񸱱Ͻ
+ * طŲ¼еʱȴҪ豸ʱģ豸ģ֮ϻط
+ * @param disk طŵĴ̣С뱻ٵĴһ
+ * @param path ļ·
+ * @param buffer дõĻ
+ * @param buf_size ֽΪһ
+ * @param stat طŵͳϢΪ0
+ * @return
+ */
+xfat_err_t vdisk_trace_replay(xdisk_t * disk, const char * path, u8_t * buffer, u32_t buf_size, vdisk_trace_stat_t * stat) {
+    vdisk_trace_rec_t rec_buf[TRACE_REPLAY_REC_NR];
+    u32_t buf_sectors = buf_size / disk->sector_size;
+    vdisk_trace_stat_t replay_stat;
+    vdisk_trace_hdr_t hdr;
+    xfat_err_t err = FS_ERR_OK;
+    size_t rec_count;
+    FILE * file;
+
+    if (buf_sectors == 0) {
+        return FS_ERR_PARAM;
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("open trace file %s failed!\n", path);
+        return FS_ERR_IO;
+    }
+
+    if ((fread(&hdr, sizeof(hdr), 1, file) != 1) || (hdr.magic != VDISK_TRACE_MAGIC)
+        || (hdr.version != VDISK_TRACE_VERSION) || (hdr.rec_size != sizeof(vdisk_trace_rec_t))) {
+        printf("invalid trace file %s!\n", path);
+        fclose(file);
+        return FS_ERR_PARAM;
+    }
+
+    if (hdr.sector_size != disk->sector_size) {
+        printf("trace sector size %d, disk %d\n", (int)hdr.sector_size, (int)disk->sector_size);
+        fclose(file);
+        return FS_ERR_PARAM;
+    }
+
+    memset(&replay_stat, 0, sizeof(replay_stat));
+    while ((err >= 0) && ((rec_count = fread(rec_buf, sizeof(vdisk_trace_rec_t), TRACE_REPLAY_REC_NR, file)) > 0)) {
+        vdisk_trace_rec_t * rec = rec_buf;
+
+        for (; (rec_count > 0) && (err >= 0); rec_count--, rec++) {
+            switch (rec->op) {
+            case VDISK_TRACE_READ:
+                replay_stat.read_count++;
+                replay_stat.read_sectors += rec->count;
+                err = trace_replay_rw(disk, rec, buffer, buf_sectors);
+                break;
+            case VDISK_TRACE_WRITE:
+                replay_stat.write_count++;
+                replay_stat.write_sectors += rec->count;
+                err = trace_replay_rw(disk, rec, buffer, buf_sectors);
+                break;
+            case VDISK_TRACE_ZEROES:
+                replay_stat.write_count++;
+                replay_stat.write_sectors += rec->count;
+                err = xdisk_write_zeroes(disk, rec->start_sector, rec->count);
+                break;
+            case VDISK_TRACE_DISCARD:
+                replay_stat.other_count++;
+                err = xdisk_discard(disk, rec->start_sector, rec->count);
+                break;
+            case VDISK_TRACE_SYNC:
+                replay_stat.other_count++;
+                err = xdisk_sync(disk);
+                break;
+            default:
+                err = FS_ERR_PARAM;
+                break;
+            }
+        }
+    }
+
+    fclose(file);
+    if (stat) {
+        *stat = replay_stat;
+    }
+    return err;
+}
@@ -0,0 +1,529 @@
+/**
+ * Դ׵ĿγΪ - 01дFAT32ļϵͳÿ̶Ӧһʱע͡
+ * ߣͭ
+ * γַhttp://01ketang.cc
+ * ȨԴǿԴοǰϵߡ
+ */
+#ifdef __linux__
+
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "xdisk.h"
+#include "xfat.h"
+#include "driver.h"
+
+#define URING_QUEUE_DEPTH       32          // ͬʱ;
+#define URING_DISK_MAX          4           // ͬʱ򿪵Ĵ
+
+/**
+ * ;Ķд󣬶̶дʱݴʣಿ
+ */
+typedef struct _uring_req_t {
+    u8_t is_write;
+    u8_t is_busy;
+    u8_t * buffer;
+    u32_t size;
+    off_t offset;
+}uring_req_t;
+
+/**
+ * io_uringʵύɶоͨmmapں˹
+ */
+typedef struct _uring_t {
+    u8_t is_used;
+    int fd;                             // ӳļ
+    int ring_fd;                        // io_uringʵ
+
+    unsigned * sq_head, * sq_tail, * sq_mask, * sq_array;
+    struct io_uring_sqe * sqes;
+    unsigned * cq_head, * cq_tail, * cq_mask;
+    struct io_uring_cqe * cqes;
+
+    void * sq_ring;
+    size_t sq_ring_size;
+    void * cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    u32_t to_submit;                    // ѷύУδ֪ͨں˵
+    u32_t in_flight;                    // δɵ
+    xfat_err_t err;                     // е׸wait_ioȡ
+    uring_req_t req[URING_QUEUE_DEPTH];
+}uring_t;
+
+static uring_t uring_tbl[URING_DISK_MAX];
+
+/**
+ * io_uringʵӳύɶ
+ * @param ring
+ * @return
+ */
+static xfat_err_t uring_setup(uring_t * ring) {
+    struct io_uring_params p;
+    u8_t * sq_ptr, * cq_ptr;
+
+    memset(&p, 0, sizeof(p));
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &p);
+    if (ring->ring_fd < 0) {
+        return FS_ERR_IO;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    // µںУйһӳ
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(0, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->ring_fd);
+        return FS_ERR_IO;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(0, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->ring_fd);
+            return FS_ERR_IO;
+        }
+    }
+
+    ring->sqes = (struct io_uring_sqe *)mmap(0, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->ring_fd);
+        return FS_ERR_IO;
+    }
+
+    sq_ptr = (u8_t *)ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+
+    cq_ptr = (u8_t *)ring->cq_ring;
+    ring->cq_head = (unsigned *)(cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+
+    ring->to_submit = 0;
+    ring->in_flight = 0;
+    ring->err = FS_ERR_OK;
+    memset(ring->req, 0, sizeof(ring->req));
+    return FS_ERR_OK;
+}
+
+/**
+ * io_uringʵ
+ * @param ring
+ */
+static void uring_destroy(uring_t * ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->ring_fd);
+}
+
+/**
+ * ύУݲ֪ͨں
+ * Сͬпеʱύбпλ
+ * @param ring
+ * @param slot е
+ */
+static void uring_push(uring_t * ring, u32_t slot) {
+    uring_req_t * req = ring->req + slot;
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe * sqe = ring->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = req->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = ring->fd;
+    sqe->addr = (u64_t)(uintptr_t)req->buffer;
+    sqe->len = req->size;
+    sqe->off = (u64_t)req->offset;
+    sqe->user_data = slot;
+    ring->sq_array[index] = index;
+
+    // ں˿µtailǰݱд
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+/**
+ * ֪ͨں˴ύе󣬲ɵȴ
+ * @param ring
+ * @param min_complete ٵȴɵ
+ * @return
+ */
+static xfat_err_t uring_enter(uring_t * ring, u32_t min_complete) {
+    while ((ring->to_submit > 0) || (min_complete > 0)) {
+        unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+        long ret = syscall(__NR_io_uring_enter, ring->ring_fd, ring->to_submit, min_complete, flags, NULL, 0);
+        if (ret < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN)) {
+                continue;
+            }
+            return FS_ERR_IO;
+        }
+
+        ring->to_submit -= (u32_t)ret;
+        if (min_complete > 0) {
+            break;
+        }
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ɶен
+ * ̶дʱʣಿ·ύУʱ¼׸
+ * @param ring
+ */
+static void uring_reap(uring_t * ring) {
+    unsigned head = *ring->cq_head;
+
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe * cqe = ring->cqes + (head & *ring->cq_mask);
+        uring_req_t * req = ring->req + (u32_t)cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        if ((res == -EINTR) || (res == -EAGAIN)) {
+            uring_push(ring, (u32_t)cqe->user_data);
+            continue;
+        }
+
+        if ((res > 0) && ((u32_t)res < req->size)) {
+            req->buffer += res;
+            req->offset += res;
+            req->size -= (u32_t)res;
+            uring_push(ring, (u32_t)cqe->user_data);
+            continue;
+        }
+
+        // д0ֽ˵Խӳĩβ
+        if ((res <= 0) && (ring->err == FS_ERR_OK)) {
+            printf("%s disk failed:offset:%lld, size:%d\n", req->is_write ? "write" : "read",
+                   (long long)req->offset, (int)req->size);
+            ring->err = FS_ERR_IO;
+        }
+
+        req->is_busy = 0;
+        ring->in_flight--;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * ʼ豸
+ * @param disk ʼ豸
+ * @param init_data ӳļ·
+ * @return
+ */
+static xfat_err_t xdisk_uring_open(xdisk_t *disk, void * init_data) {
+    const char * path = (const char *)init_data;
+    uring_t * ring = (uring_t *)0;
+    u64_t size;
+    int i;
+
+    for (i = 0; i < URING_DISK_MAX; i++) {
+        if (!uring_tbl[i].is_used) {
+            ring = uring_tbl + i;
+            break;
+        }
+    }
+    if (ring == (uring_t *)0) {
+        printf("too many disks opened:%s\n", path);
+        return FS_ERR_NO_BUFFER;
+    }
+
+    ring->fd = open(path, O_RDWR);
+    if (ring->fd < 0) {
+        printf("open disk failed:%s\n", path);
+        return FS_ERR_IO;
+    }
+
+    if ((xdisk_fd_geometry(ring->fd, &disk->sector_size, &size) < 0) || (uring_setup(ring) < 0)) {
+        printf("init disk failed:%s\n", path);
+        close(ring->fd);
+        return FS_ERR_IO;
+    }
+
+    ring->is_used = 1;
+    disk->data = ring;
+    disk->total_sector = vdisk_total_sector(size, disk->sector_size);
+    return FS_ERR_OK;
+}
+
+/**
+ * ύ첽дʱȵȴ
+ * @param disk
+ * @param is_write ǷΪд
+ * @param buffer ݻ
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_uring_submit_io(xdisk_t *disk, u8_t is_write, u8_t *buffer, u32_t start_sector, u32_t count) {
+    uring_t * ring = (uring_t *)disk->data;
+    uring_req_t * req;
+    u32_t slot;
+
+    while (ring->in_flight >= URING_QUEUE_DEPTH) {
+        xfat_err_t err = uring_enter(ring, 1);
+        if (err < 0) {
+            return err;
+        }
+        uring_reap(ring);
+    }
+
+    for (slot = 0; ring->req[slot].is_busy; slot++) {}
+
+    req = ring->req + slot;
+    req->is_write = is_write;
+    req->is_busy = 1;
+    req->buffer = buffer;
+    req->size = count * disk->sector_size;
+    req->offset = (off_t)start_sector * disk->sector_size;
+    ring->in_flight++;
+
+    uring_push(ring, slot);
+    return uring_enter(ring, 0);
+}
+
+/**
+ * ȴύ
+ * @param disk
+ * @return ɵе׸
+ */
+static xfat_err_t xdisk_uring_wait_io(xdisk_t *disk) {
+    uring_t * ring = (uring_t *)disk->data;
+    xfat_err_t err;
+
+    while (ring->in_flight > 0) {
+        err = uring_enter(ring, 1);
+        if (err < 0) {
+            return err;
+        }
+        uring_reap(ring);
+    }
+
+    err = ring->err;
+    ring->err = FS_ERR_OK;
+    return err;
+}
+
+/**
+ * 豸жȡָݣύȴ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+static xfat_err_t xdisk_uring_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err = xdisk_uring_submit_io(disk, 0, buffer, start_sector, count);
+    xfat_err_t io_err = xdisk_uring_wait_io(disk);
+    return (err < 0) ? err : io_err;
+}
+
+/**
+ * 豸дָݣύȴ
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+static xfat_err_t xdisk_uring_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    xfat_err_t err = xdisk_uring_submit_io(disk, 1, buffer, start_sector, count);
+    xfat_err_t io_err = xdisk_uring_wait_io(disk);
+    return (err < 0) ? err : io_err;
+}
+
+/**
+ * ɢۼдÿΪһͬʱύȻȴȫ
+ * @param disk
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ʼ
+ * @param is_write ǷΪд
+ * @return
+ */
+static xfat_err_t xdisk_uring_rw_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector, u8_t is_write) {
+    xfat_err_t err = FS_ERR_OK, io_err;
+
+    for (; (vec_count > 0) && (err >= 0); vec_count--, vec++) {
+        err = xdisk_uring_submit_io(disk, is_write, vec->buffer, start_sector, vec->count);
+        start_sector += vec->count;
+    }
+
+    io_err = xdisk_uring_wait_io(disk);
+    return (err < 0) ? err : io_err;
+}
+
+/**
+ * жȡݣδ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+static xfat_err_t xdisk_uring_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    return xdisk_uring_rw_v(disk, vec, vec_count, start_sector, 0);
+}
+
+/**
+ * ед
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+static xfat_err_t xdisk_uring_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    return xdisk_uring_rw_v(disk, vec, vec_count, start_sector, 1);
+}
+
+/**
+ * ȴ;ɣٽͬ洢
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_uring_sync(xdisk_t * disk) {
+    uring_t * ring = (uring_t *)disk->data;
+    xfat_err_t err;
+    int ret;
+
+    err = xdisk_uring_wait_io(disk);
+    if (err < 0) {
+        return err;
+    }
+
+    do {
+        ret = fdatasync(ring->fd);
+    } while ((ret < 0) && (errno == EINTR));
+
+    return (ret < 0) ? FS_ERR_IO : FS_ERR_OK;
+}
+
+/**
+ * ӳļд򶴣ͷռĴ̿ռ
+ * ȵȴ;ɣ֮ɵд˶
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_uring_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    uring_t * ring = (uring_t *)disk->data;
+    xfat_err_t err;
+
+    err = xdisk_uring_wait_io(disk);
+    if (err < 0) {
+        return err;
+    }
+
+    if (fallocate(ring->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  (off_t)start_sector * disk->sector_size, (off_t)count * disk->sector_size) < 0) {
+        return FS_ERR_IO;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * 0ļϵͳֱɣ֧ʱشϲͨд
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+static xfat_err_t xdisk_uring_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    uring_t * ring = (uring_t *)disk->data;
+    xfat_err_t err;
+
+    err = xdisk_uring_wait_io(disk);
+    if (err < 0) {
+        return err;
+    }
+
+    if (fallocate(ring->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                  (off_t)start_sector * disk->sector_size, (off_t)count * disk->sector_size) < 0) {
+        return FS_ERR_IO;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * رմ洢豸δɵȵ
+ * @param disk
+ * @return
+ */
+static xfat_err_t xdisk_uring_close(xdisk_t * disk) {
+    uring_t * ring = (uring_t *)disk->data;
+    xfat_err_t err;
+
+    err = xdisk_uring_wait_io(disk);
+    uring_destroy(ring);
+    close(ring->fd);
+    ring->is_used = 0;
+    return err;
+}
+
+/**
+ * io_uring첽ṹ
+ */
+xdisk_driver_t vdisk_uring_driver = {
+    .open = xdisk_uring_open,
+    .close = xdisk_uring_close,
+    .read_sector = xdisk_uring_read_sector,
+    .write_sector = xdisk_uring_write_sector,
+    .read_sector_v = xdisk_uring_read_sector_v,
+    .write_sector_v = xdisk_uring_write_sector_v,
+    .sync = xdisk_uring_sync,
+    .discard = xdisk_uring_discard,
+    .write_zeroes = xdisk_uring_write_zeroes,
+    .submit_io = xdisk_uring_submit_io,
+    .wait_io = xdisk_uring_wait_io,
+    .curr_time = xdisk_hw_curr_time,
+};
+
+#endif
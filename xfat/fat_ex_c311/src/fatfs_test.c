@@ -4,30 +4,82 @@
  * γַhttp://01ketang.cc
  * ȨԴǿԴοǰϵߡ
  */
+#ifndef _WIN32
+// ֤off_tΪ64λԱ㴴4GBϡӳ
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "xdisk.h"
 #include "xfat.h"
-
-extern xdisk_driver_t vdisk_driver;
+#include "driver.h"
+
+// Windowsƽ̨ʹpread/pwritestdio˫ػ
+// TEST_RAM_DISKʱڴ̣ʱӳͬرʱдأųI/OԼʱӰ
+#if defined(TEST_RAM_DISK)
+#define test_disk_driver    vdisk_ram_driver
+#elif defined(_WIN32)
+#define test_disk_driver    vdisk_driver
+#else
+#define test_disk_driver    vdisk_fd_driver
+#endif
 
 const char * disk_path_test = "disk_test.img";
 const char * disk_path = "disk.img";
+const char * disk_path_large = "disk_large.img";
 
 static u32_t write_buffer[160*1024];
 static u32_t read_buffer[160*1024];
 
+/**
+ * ȡ򿪲ԴʱĲ
+ * ڴҪvdisk_ram_tڲͬʱ򿪵Ĳ4
+ * @param path ӳ·
+ * @return
+ */
+static void * test_disk_param(const char * path) {
+#ifdef TEST_RAM_DISK
+    static vdisk_ram_t ram_tbl[4];
+    static int ram_next;
+    vdisk_ram_t * ram = ram_tbl + (ram_next++ % 4);
+
+    memset(ram, 0, sizeof(vdisk_ram_t));
+    ram->path = path;
+    ram->save = 1;
+    return ram;
+#else
+    return (void *)path;
+#endif
+}
+
 xdisk_t disk;
 xdisk_part_t disk_part;
 xfat_t xfat;
 
+// TEST_DISK_MODELʱԴ̾SDģͷʣʱʾģ豸ʱ
+#ifdef TEST_DISK_MODEL
+static vdisk_model_t disk_model;
+#endif
+
+// TEST_DISK_TRACEʱ¼Դ̵ķʣSDģϻطţȽϻʱܲ
+#ifdef TEST_DISK_TRACE
+const char * disk_trace_path = "disk.trace";
+static vdisk_trace_t disk_trace;
+#endif
+
 // ̻д
 int disk_buf_test(xdisk_t* disk, int buf_nr) {
     xfat_err_t err;
     xfat_buf_t* disk_buf;
+    xfat_bpool_stat_t stat;
     int i;
 
+    xfat_bpool_reset_stat(&disk->obj);
+
     // дԣȫʹû
     for (i = 0; i < buf_nr; i++) {
         err = xfat_bpool_read_sector(&disk->obj, &disk_buf, i);
@@ -60,6 +112,14 @@ int disk_buf_test(xdisk_t* disk, int buf_nr) {
 
     xfat_bpool_flush(&disk->obj);
 
+    // ǰַͬڶӦȫ
+    xfat_bpool_stat(&disk->obj, &stat);
+    printf("disk cache: hit %d, miss %d, write back %d, flush %d\n",
+        stat.hit_count, stat.miss_count, stat.write_back_count, stat.flush_count);
+    if (stat.hit_count < (u32_t)buf_nr) {
+        return -1;
+    }
+
     return 0;
 }
 
@@ -73,7 +133,7 @@ int disk_io_test (void) {
 
     memset(read_buffer, 0, sizeof(read_buffer));
 
-    err = xdisk_open(&disk_test, "vidsk_test", &vdisk_driver, (void*)disk_path_test, disk_buf, sizeof(disk_buf));
+    err = xdisk_open(&disk_test, "vidsk_test", &test_disk_driver, test_disk_param(disk_path_test), disk_buf, sizeof(disk_buf));
     if (err) {
         printf("open disk failed!\n");
         return -1;
@@ -1080,6 +1140,287 @@ xfat_err_t fs_resize_test (void) {
 	return err;
 }
 
+// ̲ԣӳ񼰷λ4GB֮󣬼64λƫƼ
+// sector_sizeΪ4096ʱͬʱ4Kԭ(4Kn)µķʽд
+#define LARGE_DISK_SIZE     ((u64_t)40 << 30)                   // 40GBʹ32KBȱʡشС
+#define LARGE_PART_START    ((u64_t)5 << 30)                    // 5GBʼ
+
+int disk_large_test (u32_t sector_size) {
+    static u8_t disk_buf[XFAT_BUF_SIZE(4096, 4)];
+    xdisk_t large_disk;
+    xdisk_part_t large_part;
+    xfat_t large_xfat;
+    xfat_fmt_ctrl_t ctrl;
+    mbr_t * mbr;
+    u32_t sector;
+    xfat_err_t err;
+    FILE * file;
+
+    printf("large disk test, sector size %d...\n", (int)sector_size);
+
+    // ֻĩβдһֽڣм䲿ֲռʵʵĴ̿ռ
+    file = fopen(disk_path_large, "wb");
+    if (file == NULL) {
+        printf("create large disk failed!\n");
+        return -1;
+    }
+    vdisk_fseek(file, LARGE_DISK_SIZE - 1, SEEK_SET);
+    fputc(0, file);
+    fclose(file);
+
+    vdisk_sector_size = sector_size;
+    err = xdisk_open(&large_disk, "vdisk_large", &test_disk_driver, test_disk_param(disk_path_large), disk_buf, sizeof(disk_buf));
+    if (err) {
+        printf("open large disk failed!\n");
+        return -1;
+    }
+
+    if ((large_disk.sector_size != sector_size) || (large_disk.total_sector != (u32_t)(LARGE_DISK_SIZE / sector_size))) {
+        printf("large disk size wrong: %u sectors\n", large_disk.total_sector);
+        return -1;
+    }
+
+    // ֱӶдӳĩβд4GBƫư32λʱḲǰ
+    sector = large_disk.total_sector - 8;
+    err = xdisk_write_sector(&large_disk, (u8_t *)write_buffer, sector, 2);
+    if (err) {
+        printf("large disk write failed!\n");
+        return -1;
+    }
+
+    memset(read_buffer, 0, sizeof(read_buffer));
+    err = xdisk_write_sector(&large_disk, (u8_t *)read_buffer, sector - (u32_t)(((u64_t)4 << 30) / large_disk.sector_size), 2);
+    if (err) {
+        printf("large disk write failed!\n");
+        return -1;
+    }
+
+    err = xdisk_read_sector(&large_disk, (u8_t *)read_buffer, sector, 2);
+    if (err) {
+        printf("large disk read failed!\n");
+        return -1;
+    }
+
+    if (memcmp(read_buffer, write_buffer, large_disk.sector_size * 2) != 0) {
+        printf("large disk data no equal!\n");
+        return -1;
+    }
+
+    // ֻһMBRλ4GB֮
+    memset(read_buffer, 0, large_disk.sector_size);
+    mbr = (mbr_t *)read_buffer;
+    mbr->part_info[0].system_id = FS_WIN95_FAT32_0;
+    mbr->part_info[0].relative_sectors = (u32_t)(LARGE_PART_START / sector_size);
+    mbr->part_info[0].total_sectors = large_disk.total_sector - mbr->part_info[0].relative_sectors - 1;
+    mbr->boot_sig[0] = 0x55;
+    mbr->boot_sig[1] = 0xAA;
+    err = xdisk_write_sector(&large_disk, (u8_t *)read_buffer, 0, 1);
+    if (err) {
+        printf("large disk write mbr failed!\n");
+        return -1;
+    }
+
+    err = xdisk_get_part(&large_disk, &large_part, 0);
+    if (err < 0) {
+        printf("large disk read partition failed!\n");
+        return -1;
+    }
+
+    xfat_fmt_ctrl_init(&ctrl);
+    ctrl.vol_name = "XFAT LARGE";
+    err = xfat_format(&large_part, &ctrl);
+    if (err < 0) {
+        printf("large disk format failed!\n");
+        return err;
+    }
+
+    err = xfat_mount(&large_xfat, &large_part, "large");
+    if (err < 0) {
+        printf("large disk mount failed!\n");
+        return err;
+    }
+
+    err = xfile_mkfile("/large/big.bin");
+    if (err < 0) {
+        printf("large disk create file failed!\n");
+        return err;
+    }
+
+    err = file_write_test("/large/big.bin", 1000, 60, 4);
+    if (err < 0) {
+        printf("large disk file test failed!\n");
+        return err;
+    }
+
+    xfat_unmount(&large_xfat);
+
+    err = xdisk_close(&large_disk);
+    if (err) {
+        printf("large disk close failed!\n");
+        return -1;
+    }
+
+    vdisk_sector_size = 512;
+    remove(disk_path_large);
+    printf("large disk test ok!\n");
+    return 0;
+}
+
+#define GPT_DISK_SIZE       ((u64_t)64 << 20)                   // GPTõڴ̴С
+#define GPT_PART_START      2048                                // ʼ
+
+// Linuxļϵͳ0FC63DAF-8483-4772-8E79-3D69D8477DE4ʽʱӦΪݷ
+static const u8_t gpt_linux_guid[16] = {
+    0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47, 0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4,
+};
+
+/**
+ * дһGPTͷֻռһķ飬ֻһ
+ * @param gpt_disk 
+ * @param hdr_sector GPTͷ
+ * @param alternate_sector һGPTͷ
+ * @param entry_sector 
+ * @return
+ */
+static xfat_err_t gpt_test_write(xdisk_t * gpt_disk, u32_t hdr_sector, u32_t alternate_sector, u32_t entry_sector) {
+    u32_t sector_size = gpt_disk->sector_size;
+    gpt_header_t * hdr = (gpt_header_t *)read_buffer;
+    gpt_entry_t * entry = (gpt_entry_t *)((u8_t *)read_buffer + sector_size);
+    xfat_err_t err;
+
+    memset(read_buffer, 0, sector_size * 2);
+    memcpy(entry->type_guid, gpt_linux_guid, sizeof(gpt_linux_guid));
+    entry->unique_guid[0] = 1;
+    entry->first_lba = GPT_PART_START;
+    entry->last_lba = gpt_disk->total_sector - 64;
+
+    memcpy(hdr->signature, "EFI PART", 8);
+    hdr->revision = 0x00010000;
+    hdr->header_size = GPT_HEADER_SIZE_MIN;
+    hdr->my_lba = hdr_sector;
+    hdr->alternate_lba = alternate_sector;
+    hdr->first_usable_lba = 34;
+    hdr->last_usable_lba = gpt_disk->total_sector - 34;
+    hdr->part_entry_lba = entry_sector;
+    hdr->part_entry_count = sector_size / GPT_ENTRY_SIZE_MIN;
+    hdr->part_entry_size = GPT_ENTRY_SIZE_MIN;
+    hdr->part_entry_crc32 = xdisk_crc32(0, entry, sector_size);
+    hdr->header_crc32 = xdisk_crc32(0, hdr, GPT_HEADER_SIZE_MIN);
+
+    err = xdisk_write_sector(gpt_disk, (u8_t *)hdr, hdr_sector, 1);
+    if (err < 0) {
+        return err;
+    }
+    return xdisk_write_sector(gpt_disk, (u8_t *)entry, entry_sector, 1);
+}
+
+// GPTԣڴϽMBRGPTʽеķдļƻGPTñGPT
+int disk_gpt_test (void) {
+    static u8_t disk_buf[XFAT_BUF_SIZE(512, 4)];
+    xdisk_t gpt_disk;
+    xdisk_part_t gpt_part;
+    xfat_t gpt_xfat;
+    xfat_fmt_ctrl_t ctrl;
+    vdisk_ram_t ram;
+    mbr_t * mbr;
+    u32_t count;
+    xfat_err_t err;
+
+    memset(&ram, 0, sizeof(ram));
+    ram.size = GPT_DISK_SIZE;
+    err = xdisk_open(&gpt_disk, "vdisk_gpt", &vdisk_ram_driver, &ram, disk_buf, sizeof(disk_buf));
+    if (err) {
+        printf("open gpt disk failed!\n");
+        return -1;
+    }
+
+    // MBRֻһΪ0xEEķ
+    memset(read_buffer, 0, gpt_disk.sector_size);
+    mbr = (mbr_t *)read_buffer;
+    mbr->part_info[0].system_id = FS_GPT;
+    mbr->part_info[0].relative_sectors = 1;
+    mbr->part_info[0].total_sectors = gpt_disk.total_sector - 1;
+    mbr->boot_sig[0] = 0x55;
+    mbr->boot_sig[1] = 0xAA;
+    err = xdisk_write_sector(&gpt_disk, (u8_t *)read_buffer, 0, 1);
+    if (err < 0) {
+        printf("gpt disk write mbr failed!\n");
+        return -1;
+    }
+
+    err = gpt_test_write(&gpt_disk, GPT_HEADER_SECTOR, gpt_disk.total_sector - 1, GPT_HEADER_SECTOR + 1);
+    if (err == FS_ERR_OK) {
+        err = gpt_test_write(&gpt_disk, gpt_disk.total_sector - 1, GPT_HEADER_SECTOR, gpt_disk.total_sector - 2);
+    }
+    if (err < 0) {
+        printf("gpt disk write gpt failed!\n");
+        return -1;
+    }
+
+    err = xdisk_get_part_count(&gpt_disk, &count);
+    if ((err < 0) || (count != 1)) {
+        printf("gpt disk partition count wrong!\n");
+        return -1;
+    }
+
+    err = xdisk_get_part(&gpt_disk, &gpt_part, 0);
+    if ((err < 0) || (gpt_part.start_sector != GPT_PART_START) || (gpt_part.type != FS_GPT)) {
+        printf("gpt disk read partition failed!\n");
+        return -1;
+    }
+
+    xfat_fmt_ctrl_init(&ctrl);
+    ctrl.vol_name = "XFAT GPT";
+    err = xfat_format(&gpt_part, &ctrl);
+    if (err < 0) {
+        printf("gpt disk format failed!\n");
+        return err;
+    }
+
+    // ƻGPTͷӦӱGPTжҸʽʱѸΪݷ
+    memset(read_buffer, 0, gpt_disk.sector_size);
+    err = xdisk_write_sector(&gpt_disk, (u8_t *)read_buffer, GPT_HEADER_SECTOR, 1);
+    if (err < 0) {
+        printf("gpt disk write failed!\n");
+        return -1;
+    }
+
+    err = xdisk_get_part(&gpt_disk, &gpt_part, 0);
+    if ((err < 0) || (gpt_part.start_sector != GPT_PART_START) || (gpt_part.type != FS_WIN95_FAT32_0)) {
+        printf("gpt disk read backup partition failed!\n");
+        return -1;
+    }
+
+    err = xfat_mount(&gpt_xfat, &gpt_part, "gpt");
+    if (err < 0) {
+        printf("gpt disk mount failed!\n");
+        return err;
+    }
+
+    err = xfile_mkfile("/gpt/gpt.bin");
+    if (err < 0) {
+        printf("gpt disk create file failed!\n");
+        return err;
+    }
+
+    err = file_write_test("/gpt/gpt.bin", 1000, 60, 4);
+    if (err < 0) {
+        printf("gpt disk file test failed!\n");
+        return err;
+    }
+
+    xfat_unmount(&gpt_xfat);
+
+    err = xdisk_close(&gpt_disk);
+    if (err) {
+        printf("gpt disk close failed!\n");
+        return -1;
+    }
+
+    printf("gpt disk test ok!\n");
+    return 0;
+}
+
 xfat_err_t fs_format_test(void) {
     xdisk_part_t fmt_part;
     xfat_err_t err;
@@ -1105,11 +1446,66 @@ xfat_err_t fs_format_test(void) {
     return err;
 }
 
+#ifdef TEST_DISK_TRACE
+// ٻطŲԣڲдصڴϻطţ˶ʾSDģµĺʱ
+int disk_trace_replay_test(vdisk_trace_stat_t * trace_stat) {
+    static u8_t replay_disk_buf[XFAT_BUF_SIZE(512, 4)];
+    vdisk_trace_stat_t stat;
+    vdisk_model_t model;
+    vdisk_ram_t ram;
+    xdisk_t replay_disk;
+    xfat_err_t err;
+
+    memset(&ram, 0, sizeof(ram));
+    ram.path = disk_path;
+    memset(&model, 0, sizeof(model));
+    model.driver = &vdisk_ram_driver;
+    model.init_data = &ram;
+    model.cfg = vdisk_model_sd;
+    err = xdisk_open(&replay_disk, "replay", &vdisk_model_driver, &model, replay_disk_buf, sizeof(replay_disk_buf));
+    if (err) {
+        printf("open replay disk failed!\n");
+        return -1;
+    }
+
+    err = vdisk_trace_replay(&replay_disk, disk_trace_path, (u8_t *)read_buffer, sizeof(read_buffer), &stat);
+    if (err) {
+        printf("replay trace failed!\n");
+        return -1;
+    }
+
+    if ((stat.read_count != trace_stat->read_count) || (stat.write_count != trace_stat->write_count)
+        || (stat.read_sectors != trace_stat->read_sectors) || (stat.write_sectors != trace_stat->write_sectors)) {
+        printf("replay stat not match!\n");
+        return -1;
+    }
+
+    printf("replay: read %u cmds %u sectors, write %u cmds %u sectors, sd model %u ms\n",
+        stat.read_count, (u32_t)stat.read_sectors, stat.write_count, (u32_t)stat.write_sectors,
+        (u32_t)(model.stat.time_ns / 1000000));
+
+    err = xdisk_close(&replay_disk);
+    if (err) {
+        printf("close replay disk failed!\n");
+        return -1;
+    }
+    return 0;
+}
+#endif
+
 int main (void) {
     xfat_err_t err;
     int i;
     static u8_t disk_buf[XFAT_BUF_SIZE(512, 4)];
     static u8_t fat_buf[XFAT_BUF_SIZE(512, 4)];
+#ifdef TEST_FAT_MIRROR
+    u8_t * fat_mirror_buf;
+    u32_t fat_mirror_size;
+#endif
+#ifdef TEST_FREE_BITMAP
+    u8_t * free_bitmap_buf;
+    u32_t free_bitmap_size;
+#endif
 
     for (i = 0; i < sizeof(write_buffer) / sizeof(u32_t); i++) {
         write_buffer[i] = i;
@@ -1118,7 +1514,19 @@ int main (void) {
     err = disk_io_test();
     if (err) return err;
 
-    err = xdisk_open(&disk, "vidsk", &vdisk_driver, (void*)disk_path, disk_buf, sizeof(disk_buf));
+#ifdef TEST_DISK_MODEL
+    disk_model.driver = &test_disk_driver;
+    disk_model.init_data = test_disk_param(disk_path);
+    disk_model.cfg = vdisk_model_sd;
+    err = xdisk_open(&disk, "vidsk", &vdisk_model_driver, &disk_model, disk_buf, sizeof(disk_buf));
+#elif defined(TEST_DISK_TRACE)
+    disk_trace.driver = &test_disk_driver;
+    disk_trace.init_data = test_disk_param(disk_path);
+    disk_trace.path = disk_trace_path;
+    err = xdisk_open(&disk, "vidsk", &vdisk_trace_driver, &disk_trace, disk_buf, sizeof(disk_buf));
+#else
+    err = xdisk_open(&disk, "vidsk", &test_disk_driver, test_disk_param(disk_path), disk_buf, sizeof(disk_buf));
+#endif
     if (err) {
         printf("open disk failed!\n");
         return -1;
@@ -1150,6 +1558,35 @@ int main (void) {
         return err;
     }
 
+    // ҪFATĿ¼2QԱⱻļд
+    err = xfat_set_buf_policy(&xfat, XFAT_BUF_POLICY_2Q);
+    if (err < 0) {
+        printf("set fat buffer policy failed!\n");
+        return err;
+    }
+
+#ifdef TEST_FAT_MIRROR
+    // TEST_FAT_MIRRORʱFATڴ棬ʱдFAT
+    fat_mirror_size = XFAT_FAT_MIRROR_SIZE(xfat.fat_tbl_sectors, disk.sector_size);
+    fat_mirror_buf = (u8_t *)malloc(fat_mirror_size);
+    err = xfat_set_fat_mirror(&xfat, fat_mirror_buf, fat_mirror_size);
+    if (err < 0) {
+        printf("set fat mirror failed!\n");
+        return err;
+    }
+#endif
+
+#ifdef TEST_FREE_BITMAP
+    // TEST_FREE_BITMAPʱÿдλͼҿдأɨFAT
+    free_bitmap_size = XFAT_FREE_BITMAP_SIZE(xfat.fat_tbl_sectors, disk.sector_size);
+    free_bitmap_buf = (u8_t *)malloc(free_bitmap_size);
+    err = xfat_set_free_bitmap(&xfat, free_bitmap_buf, free_bitmap_size);
+    if (err < 0) {
+        printf("set free bitmap failed!\n");
+        return err;
+    }
+#endif
+
     err = fat_dir_test();
     if (err) return err;
 
@@ -1186,18 +1623,55 @@ int main (void) {
     err = fs_resize_test();
     if (err) return err;
 
+#ifdef TEST_FAT_MIRROR
+    err = xfat_sync(&xfat);
+    if ((err < 0) || xfat.fat_dirty_count) {
+        printf("fat mirror sync failed!\n");
+        return -1;
+    }
+#endif
+
     // umountٹdisk!!!
     xfat_unmount(&xfat);
+#ifdef TEST_FAT_MIRROR
+    free(fat_mirror_buf);
+#endif
+#ifdef TEST_FREE_BITMAP
+    free(free_bitmap_buf);
+#endif
 
     err = fs_format_test();
     if (err) return err;
 
+    // ڴ轫ӳڴ棬
+#ifndef TEST_RAM_DISK
+    err = disk_large_test(512);
+    if (err) return err;
+
+    err = disk_large_test(4096);
+    if (err) return err;
+#endif
+
+    err = disk_gpt_test();
+    if (err) return err;
+
+#ifdef TEST_DISK_MODEL
+    printf("disk model: %u ms, read %u cmds, write %u cmds, erase %u, rmw %u\n",
+        (u32_t)(disk_model.stat.time_ns / 1000000), disk_model.stat.read_count, disk_model.stat.write_count,
+        disk_model.stat.erase_count, disk_model.stat.rmw_count);
+#endif
+
     err = xdisk_close(&disk);
     if (err) {
         printf("disk close failed!\n");
         return -1;
     }
 
+#ifdef TEST_DISK_TRACE
+    err = disk_trace_replay_test(&disk_trace.stat);
+    if (err) return err;
+#endif
+
     printf("Test End!\n");
     return 0;
 }
@@ -4,9 +4,15 @@
  * γַhttp://01ketang.cc
  * ȨԴǿԴοǰϵߡ
  */
+#include <string.h>
 #include "xfat.h"
 #include "xdisk.h"
 
+static u8_t zero_buffer[XDISK_ZERO_BUF_SIZE];          // ȫ0Ĺ壬ֻ
+
+static xfat_err_t disk_scan_part(xdisk_t * disk);
+static void disk_part_on_write(xdisk_t * disk, const u8_t * buffer, u32_t start_sector, u32_t count);
+
 /**
  * ʼ豸
  * @param disk ʼ豸
@@ -20,6 +26,8 @@ xfat_err_t xdisk_open(xdisk_t* disk, const char* name, xdisk_driver_t* driver,
     xfat_obj_init(&disk->obj, XFAT_OBJ_DISK);
 
     disk->driver = driver;
+    disk->bpool_tick = 0;
+    disk->buf_align = 0;
 
     // ײʼ
     err = disk->driver->open(disk, init_data);
@@ -27,11 +35,22 @@ xfat_err_t xdisk_open(xdisk_t* disk, const char* name, xdisk_driver_t* driver,
         return err;
     }
 
-    err = xfat_bpool_init(&disk->obj, disk->sector_size, disk_buf, buf_size);
+    // СΪ512~4096֮2ݣFAT32BPB_BytsPerSecȡֵһ
+    if ((disk->sector_size < XDISK_SECTOR_SIZE_MIN) || (disk->sector_size > XDISK_SECTOR_SIZE_MAX)
+        || (disk->sector_size & (disk->sector_size - 1))) {
+        disk->driver->close(disk);
+        return FS_ERR_PARAM;
+    }
+
+    err = xfat_bpool_init(&disk->obj, disk->sector_size, disk_buf, buf_size, disk->buf_align);
     if (err < 0) {
         return err;
     }
 
+    // ֮ķѯٶMBREBRʧʱѯʱؽ
+    disk->part_valid = 0;
+    disk_scan_part(disk);
+
     disk->name = name;
     return FS_ERR_OK;
 }
@@ -57,6 +76,81 @@ xfat_err_t xdisk_close(xdisk_t * disk) {
     return err;
 }
 
+/**
+ * ̻漰δ̵ͬд洢
+ * д֤̣Ҫ־ûʱϲʽ
+ * @param disk
+ * @return
+ */
+xfat_err_t xdisk_sync(xdisk_t * disk) {
+    xfat_err_t err;
+
+    err = xfat_bpool_flush(to_obj(disk));
+    if (err < 0) {
+        return err;
+    }
+
+    if (disk->driver->sync) {
+        err = disk->driver->sync(disk);
+    }
+
+    return err;
+}
+
+/**
+ * ֪ͨ豸ָеѲҪ豸ɻռ
+ * ֮ȡЩõݲȷ֧ʱֱӺ
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+xfat_err_t xdisk_discard(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    if (disk->driver->discard == 0) {
+        return FS_ERR_OK;
+    }
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    return disk->driver->discard(disk, start_sector, count);
+}
+
+/**
+ * Ķ0棬еӦ
+ * ֻ֧0ʧʱΪùȫ0ֿд
+ * @param disk
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+xfat_err_t xdisk_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count) {
+    u32_t max_count = XDISK_ZERO_BUF_SIZE / disk->sector_size;
+    xfat_err_t err = FS_ERR_OK, io_err;
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    disk_part_on_write(disk, (const u8_t *)0, start_sector, count);
+    if (disk->driver->write_zeroes && (disk->driver->write_zeroes(disk, start_sector, count) >= 0)) {
+        return FS_ERR_OK;
+    }
+
+    // ͬҲᱻ޸ģ֧첽ʱͬʱύ
+    while ((count > 0) && (err >= 0)) {
+        u32_t curr_count = (count > max_count) ? max_count : count;
+
+        err = xdisk_submit_write(disk, zero_buffer, start_sector, curr_count);
+        start_sector += curr_count;
+        count -= curr_count;
+    }
+
+    io_err = xdisk_wait_io(disk);
+    return (err < 0) ? err : io_err;
+}
+
 /**
  * 豸жȡָ
  * @param disk ȡĴ
@@ -68,7 +162,7 @@ xfat_err_t xdisk_close(xdisk_t * disk) {
 xfat_err_t xdisk_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
     xfat_err_t err;
 
-    if (start_sector + count >= disk->total_sector) {
+    if ((u64_t)start_sector + count > disk->total_sector) {
         return FS_ERR_PARAM;
     }
 
@@ -87,14 +181,192 @@ xfat_err_t xdisk_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u3
 xfat_err_t xdisk_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
     xfat_err_t err;
 
-    if (start_sector + count >= disk->total_sector) {
+    if ((u64_t)start_sector + count > disk->total_sector) {
         return FS_ERR_PARAM;
     }
 
+    disk_part_on_write(disk, buffer, start_sector, count);
+
     err = disk->driver->write_sector(disk, buffer, start_sector, count);
     return err;
 }
 
+/**
+ * ͳƷɢ/ۼд
+ * @param vec
+ * @param vec_count
+ * @return
+ */
+static u32_t xdisk_vec_sectors(const xdisk_vec_t *vec, u32_t vec_count) {
+    u32_t count = 0;
+
+    while (vec_count--) {
+        count += vec++->count;
+    }
+    return count;
+}
+
+/**
+ * жȡݣδ
+ * ַ֧ɢʱζȡ
+ * @param disk ȡĴ
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector ȡʼ
+ * @return
+ */
+xfat_err_t xdisk_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    xfat_err_t err;
+
+    if ((u64_t)start_sector + xdisk_vec_sectors(vec, vec_count) > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    if (disk->driver->read_sector_v) {
+        return disk->driver->read_sector_v(disk, vec, vec_count, start_sector);
+    }
+
+    for (; vec_count > 0; vec_count--, vec++) {
+        err = disk->driver->read_sector(disk, vec->buffer, start_sector, vec->count);
+        if (err < 0) {
+            return err;
+        }
+        start_sector += vec->count;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ед
+ * ֧־ۼдʱд
+ * @param disk дĴ洢豸
+ * @param vec λ
+ * @param vec_count 
+ * @param start_sector дʼ
+ * @return
+ */
+xfat_err_t xdisk_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector) {
+    u32_t count = xdisk_vec_sectors(vec, vec_count);
+    u32_t i, sector;
+    xfat_err_t err;
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    for (i = 0, sector = start_sector; i < vec_count; sector += vec[i++].count) {
+        disk_part_on_write(disk, vec[i].buffer, sector, vec[i].count);
+    }
+
+    if (disk->driver->write_sector_v) {
+        return disk->driver->write_sector_v(disk, vec, vec_count, start_sector);
+    }
+
+    for (; vec_count > 0; vec_count--, vec++) {
+        err = disk->driver->write_sector(disk, vec->buffer, start_sector, vec->count);
+        if (err < 0) {
+            return err;
+        }
+        start_sector += vec->count;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ύ첽ʱݲһѶ룬xdisk_wait_ioȴ
+ * ڴ֮ǰbuffer뱣ЧҲܷе
+ * ֧첽ʱֱͬȡ
+ * @param disk ȡĴ
+ * @param buffer ȡݴ洢Ļ
+ * @param start_sector ȡʼ
+ * @param count ȡ
+ * @return
+ */
+xfat_err_t xdisk_submit_read(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    if (disk->driver->submit_io == 0) {
+        return xdisk_read_sector(disk, buffer, start_sector, count);
+    }
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    return disk->driver->submit_io(disk, 0, buffer, start_sector, count);
+}
+
+/**
+ * ύ첽дxdisk_wait_ioȴɣڴ֮ǰbuffer뱣ЧҲ޸
+ * ֧첽ʱֱͬд
+ * @param disk дĴ洢豸
+ * @param buffer Դ
+ * @param start_sector дʼ
+ * @param count д
+ * @return
+ */
+xfat_err_t xdisk_submit_write(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count) {
+    if (disk->driver->submit_io == 0) {
+        return xdisk_write_sector(disk, buffer, start_sector, count);
+    }
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    disk_part_on_write(disk, buffer, start_sector, count);
+    return disk->driver->submit_io(disk, 1, buffer, start_sector, count);
+}
+
+/**
+ * ȴύ첽д
+ * ʹύʱύڽУҲҪñ
+ * @param disk
+ * @return ɵе׸
+ */
+xfat_err_t xdisk_wait_io(xdisk_t *disk) {
+    if (disk->driver->wait_io == 0) {
+        return FS_ERR_OK;
+    }
+
+    return disk->driver->wait_io(disk);
+}
+
+/**
+ * ָӳ䵽ڴ棬ؿֱӶдĵַдӳд
+ * ӳxdisk_unmap_sectorرմǰһֱЧ
+ * @param disk ӳĴ
+ * @param start_sector ʼ
+ * @param count 
+ * @param addr ӳõĵַ
+ * @return ֧ӳʱFS_ERR_NONE
+ */
+xfat_err_t xdisk_map_sector(xdisk_t *disk, u32_t start_sector, u32_t count, u8_t ** addr) {
+    if (disk->driver->map_sector == 0) {
+        return FS_ERR_NONE;
+    }
+
+    if ((u64_t)start_sector + count > disk->total_sector) {
+        return FS_ERR_PARAM;
+    }
+
+    return disk->driver->map_sector(disk, start_sector, count, addr);
+}
+
+/**
+ * xdisk_map_sectorӳ
+ * @param disk ӳĴ
+ * @param addr ӳõĵַ
+ * @param start_sector ʼ
+ * @param count 
+ * @return
+ */
+xfat_err_t xdisk_unmap_sector(xdisk_t *disk, u8_t * addr, u32_t start_sector, u32_t count) {
+    if (disk->driver->unmap_sector == 0) {
+        return FS_ERR_OK;
+    }
+
+    return disk->driver->unmap_sector(disk, addr, start_sector, count);
+}
+
 /**
  * ȡǰʱ
  * @param timeinfo ʱ洢
@@ -107,17 +379,108 @@ xfat_err_t xdisk_curr_time(xdisk_t *disk, struct _xfile_time_t *timeinfo) {
     return err;
 }
 
+static u32_t crc32_tbl[8][256];           // CRC32ķƬұ״ʹʱ
+static u8_t crc32_tbl_ready;
+
 /**
- * ȡչµӷ
+ * CRC32(IEEE 802.3ʽ0xEDB88320)ķƬұ
+ * crc32_tbl[k][n]Ϊֽn֮پk0ֽڵÿβд8ֽ
+ */
+static void crc32_init_tbl(void) {
+    u32_t i, k;
+
+    for (i = 0; i < 256; i++) {
+        u32_t crc = i;
+
+        for (k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+        crc32_tbl[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        for (k = 1; k < 8; k++) {
+            crc32_tbl[k][i] = (crc32_tbl[k - 1][i] >> 8) ^ crc32_tbl[0][crc32_tbl[k - 1][i] & 0xFF];
+        }
+    }
+    crc32_tbl_ready = 1;
+}
+
+/**
+ * CRC32GPTzipʹõ㷨ͬ
+ * 8ֽΪһֽڼɷֶμ㣬ǰһεĽΪһεcrc
+ * @param crc ֮ǰεCRC32׶Ϊ0
+ * @param data 
+ * @param size ֽ
+ * @return
+ */
+u32_t xdisk_crc32(u32_t crc, const void * data, u32_t size) {
+    const u8_t * p = (const u8_t *)data;
+
+    if (!crc32_tbl_ready) {
+        crc32_init_tbl();
+    }
+
+    crc = ~crc;
+    while (size >= 8) {
+        u32_t lo = crc ^ ((u32_t)p[0] | ((u32_t)p[1] << 8) | ((u32_t)p[2] << 16) | ((u32_t)p[3] << 24));
+        u32_t hi = (u32_t)p[4] | ((u32_t)p[5] << 8) | ((u32_t)p[6] << 16) | ((u32_t)p[7] << 24);
+
+        crc = crc32_tbl[7][lo & 0xFF] ^ crc32_tbl[6][(lo >> 8) & 0xFF]
+            ^ crc32_tbl[5][(lo >> 16) & 0xFF] ^ crc32_tbl[4][lo >> 24]
+            ^ crc32_tbl[3][hi & 0xFF] ^ crc32_tbl[2][(hi >> 8) & 0xFF]
+            ^ crc32_tbl[1][(hi >> 16) & 0xFF] ^ crc32_tbl[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        crc = (crc >> 8) ^ crc32_tbl[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+/**
+ * һ
+ * @param disk 洢豸
+ * @param start_sector ʼ
+ * @param total_sector 
+ * @param relative_sector м¼
+ * @param type 
+ * @param desc_sector ڵ
+ * @param desc_index ڸķе
+ * @return ʱFS_ERR_EOF
+ */
+static xfat_err_t disk_part_add(xdisk_t * disk, u32_t start_sector, u32_t total_sector, u32_t relative_sector,
+                    u8_t type, u32_t desc_sector, u32_t desc_index) {
+    xdisk_part_ent_t * ent;
+
+    if (disk->part_count >= XDISK_PART_MAX) {
+        return FS_ERR_EOF;
+    }
+
+    ent = disk->part_tbl + disk->part_count++;
+    ent->start_sector = start_sector;
+    ent->total_sector = total_sector;
+    ent->relative_sector = relative_sector;
+    ent->desc_sector = desc_sector;
+    ent->desc_index = (u8_t)desc_index;
+    ent->type = type;
+    if (desc_sector > disk->part_desc_max) {
+        disk->part_desc_max = desc_sector;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * չµEBRӷӵ
  * @param disk չڵĴ洢豸
- * @param start_sector չڵʼ
- * @param count ѯõӷ
+ * @param ext_start_sector չʼ
  * @return
  */
-static xfat_err_t disk_get_extend_part_count(xdisk_t * disk, u32_t start_sector, u32_t * count) {
-    int r_count = 0;
+static xfat_err_t disk_scan_extend_part(xdisk_t * disk, u32_t ext_start_sector) {
+    u32_t start_sector = ext_start_sector;
 
-    u32_t ext_start_sector = start_sector;
     do {
         mbr_part_t * part;
         xfat_buf_t * disk_buf;
@@ -134,7 +497,11 @@ static xfat_err_t disk_get_extend_part_count(xdisk_t * disk, u32_t start_sector,
             break;
         }
 
-        r_count++;
+        // ʱټEBRлʱҲڴ˽
+        if (disk_part_add(disk, start_sector + part->relative_sectors, part->total_sectors,
+                    part->relative_sectors, part->system_id, start_sector, 0) < 0) {
+            break;
+        }
 
         // ûк, ˳
         if ((++part)->system_id != FS_EXTEND) {
@@ -145,263 +512,491 @@ static xfat_err_t disk_get_extend_part_count(xdisk_t * disk, u32_t start_sector,
         start_sector = ext_start_sector + part->relative_sectors;
     } while (1);
 
-    *count = r_count;
     return FS_ERR_OK;
 }
 
+static const u8_t gpt_signature[8] = {'E', 'F', 'I', ' ', 'P', 'A', 'R', 'T'};
+
+// ݷEBD0A0A2-B9E5-4433-87C0-68B6B72699C7GUIDǰ3ΰС˴洢
+static const u8_t gpt_type_basic_data[16] = {
+    0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44, 0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7,
+};
+
+// EFIϵͳC12A7328-F81F-11D2-BA4B-00A0C93EC93B
+static const u8_t gpt_type_efi_system[16] = {
+    0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11, 0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B,
+};
+
+static const u8_t gpt_type_unused[16];
+
 /**
- * ȡ豸ܵķ
- * @param disk ѯĴ洢豸
- * @param count 洢λ
- * @return
+ * GUIDǷʾΪFATķ
  */
-xfat_err_t xdisk_get_part_count(xdisk_t *disk, u32_t *count) {
-	int r_count = 0, i = 0;
-    mbr_part_t * part;
-    u8_t extend_part_flag = 0;
-    u32_t start_sector[4];
-    xfat_buf_t* disk_buf = (xfat_buf_t*)0;
-
-    // ȡmbr
-    xfat_err_t err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
-	if (err < 0) {
-		return err;
-	}
-
-	// ͳǳĸչ
-	part = ((mbr_t *)disk_buf->buf)->part_info;
-	for (i = 0; i < MBR_PRIMARY_PART_NR; i++, part++) {
-		if (part->system_id == FS_NOT_VALID) {
-            continue;
-        } else if (part->system_id == FS_EXTEND) {
-            start_sector[i] = part->relative_sectors;
-            extend_part_flag |= 1 << i;
-        } else {
-            r_count++;
-        }
-	}
-
-	// ͳƸչжٸӷ
-    if (extend_part_flag) {
-        for (i = 0; i < MBR_PRIMARY_PART_NR; i++) {
-            if (extend_part_flag & (1 << i)) {
-                u32_t ext_count = 0;
-                err = disk_get_extend_part_count(disk, start_sector[i], &ext_count);
-                if (err < 0) {
-                    return err;
-                }
-
-                r_count += ext_count;
-            }
-        }
+static int gpt_type_is_fat(const u8_t * type_guid) {
+    return (memcmp(type_guid, gpt_type_basic_data, 16) == 0) || (memcmp(type_guid, gpt_type_efi_system, 16) == 0);
+}
+
+/**
+ * ȡУGPTͷ
+ * @param disk 洢豸
+ * @param sector GPTͷڵ
+ * @param hdr УͨGPTͷ
+ * @return ЧGPTͷʱFS_ERR_INVALID_FS
+ */
+static xfat_err_t gpt_read_header(xdisk_t * disk, u32_t sector, gpt_header_t * hdr) {
+    static const u8_t zero_crc[4];
+    xfat_buf_t* disk_buf;
+    u64_t array_sectors;
+    u32_t crc;
+
+    xfat_err_t err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, sector);
+    if (err < 0) {
+        return err;
     }
 
-    *count = r_count;
-	return FS_ERR_OK;
+    memcpy(hdr, disk_buf->buf, sizeof(gpt_header_t));
+    if ((memcmp(hdr->signature, gpt_signature, sizeof(gpt_signature)) != 0)
+        || (hdr->header_size < GPT_HEADER_SIZE_MIN) || (hdr->header_size > disk->sector_size)
+        || (hdr->my_lba != sector)) {
+        return FS_ERR_INVALID_FS;
+    }
+
+    // CRCʱheader_crc32ֶΰ0
+    crc = xdisk_crc32(0, disk_buf->buf, 16);
+    crc = xdisk_crc32(crc, zero_crc, sizeof(zero_crc));
+    crc = xdisk_crc32(crc, disk_buf->buf + 20, hdr->header_size - 20);
+    if (crc != hdr->header_crc32) {
+        return FS_ERR_INVALID_FS;
+    }
+
+    // СΪ1282ݱҲСÿ
+    if ((hdr->part_entry_size < GPT_ENTRY_SIZE_MIN) || (hdr->part_entry_size > disk->sector_size)
+        || (hdr->part_entry_size & (hdr->part_entry_size - 1))) {
+        return FS_ERR_INVALID_FS;
+    }
+
+    array_sectors = ((u64_t)hdr->part_entry_count * hdr->part_entry_size + disk->sector_size - 1) / disk->sector_size;
+    if (hdr->part_entry_lba + array_sectors > disk->total_sector) {
+        return FS_ERR_INVALID_FS;
+    }
+    return FS_ERR_OK;
 }
 
 /**
- * ȡչ·Ϣ
- * @param disk ѯĴ洢豸
- * @param disk_part Ϣ洢λ
- * @param start_sector չʼľ
- * @param part_no ѯķ
- * @param count չһжٸӷ
+ * GPTķ飬CRC32ɽӵ
+ * ֹ32λŵķ޷ʣ
+ * @param disk 洢豸
+ * @param hdr УGPTͷ
+ * @param add Ƿӵ
+ * @param crc CRC32
  * @return
  */
-static xfat_err_t disk_get_extend_part(xdisk_t * disk, xdisk_part_t * disk_part,
-                    u32_t start_sector, int part_no, u32_t * count) {
-    int curr_no = -1;
-    xfat_err_t err = FS_ERR_OK;
+static xfat_err_t gpt_scan_entries(xdisk_t * disk, const gpt_header_t * hdr, u8_t add, u32_t * crc) {
+    u64_t remain = (u64_t)hdr->part_entry_count * hdr->part_entry_size;
+    u32_t sector = (u32_t)hdr->part_entry_lba;
 
-    // չ
-    u32_t ext_start_sector = start_sector;
-    do {
-        mbr_part_t * part;
+    *crc = 0;
+    for (; remain > 0; sector++) {
+        u32_t bytes = (remain > disk->sector_size) ? disk->sector_size : (u32_t)remain;
         xfat_buf_t* disk_buf;
+        u32_t i;
 
-        // ȡչmbr
-        err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, start_sector);
+        xfat_err_t err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, sector);
         if (err < 0) {
             return err;
         }
 
-        part = ((mbr_t *)disk_buf->buf)->part_info;
-        if (part->system_id == FS_NOT_VALID) {  // ǰЧδҵ, 
-            err = FS_ERR_EOF;
-            break;
+        *crc = xdisk_crc32(*crc, disk_buf->buf, bytes);
+        for (i = 0; add && (i * hdr->part_entry_size < bytes); i++) {
+            gpt_entry_t * entry = (gpt_entry_t *)(disk_buf->buf + i * hdr->part_entry_size);
+
+            if ((memcmp(entry->type_guid, gpt_type_unused, 16) == 0)
+                || (entry->first_lba > entry->last_lba) || (entry->last_lba >= disk->total_sector)) {
+                continue;
+            }
+
+            disk_part_add(disk, (u32_t)entry->first_lba, (u32_t)(entry->last_lba - entry->first_lba + 1),
+                (u32_t)entry->first_lba, gpt_type_is_fat(entry->type_guid) ? FS_WIN95_FAT32_0 : FS_GPT, sector, i);
         }
 
-        // ҵָķţľλϢ
-        if (++curr_no == part_no) {
-            disk_part->type = part->system_id;
-            disk_part->start_sector = start_sector + part->relative_sectors;
-            disk_part->total_sector = part->total_sectors;
-            disk_part->relative_sector = part->relative_sectors;
-            disk_part->disk = disk;
-            break;
+        remain -= bytes;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * GPT
+ * ʹGPTͷУʧʱñGPT
+ * @param disk 洢豸
+ * @return GPTЧʱش
+ */
+static xfat_err_t disk_scan_gpt(xdisk_t * disk) {
+    u32_t hdr_sector = GPT_HEADER_SECTOR;
+    u64_t alternate_lba;
+    gpt_header_t hdr;
+    u32_t crc;
+
+    xfat_err_t err = gpt_read_header(disk, hdr_sector, &hdr);
+    if (err >= 0) {
+        alternate_lba = hdr.alternate_lba;
+        err = gpt_scan_entries(disk, &hdr, 1, &crc);
+        if ((err >= 0) && (crc != hdr.part_entry_crc32)) {
+            err = FS_ERR_INVALID_FS;
         }
+    } else {
+        // GPTͷ𻵣ͷ涨λһ
+        alternate_lba = disk->total_sector - 1;
+    }
 
-        if ((++part)->system_id != FS_EXTEND) { // ޺δҵ, 
-            err = FS_ERR_EOF;
-            break;
+    if (err < 0) {
+        disk->part_count = 0;
+        disk->part_desc_max = 0;
+        if ((alternate_lba >= disk->total_sector) || (alternate_lba == GPT_HEADER_SECTOR)) {
+            return err;
         }
 
-        start_sector = ext_start_sector + part->relative_sectors;
-    } while (1);
+        hdr_sector = (u32_t)alternate_lba;
+        err = gpt_read_header(disk, hdr_sector, &hdr);
+        if (err < 0) {
+            return err;
+        }
 
-    *count = curr_no + 1;
-    return err;
+        err = gpt_scan_entries(disk, &hdr, 1, &crc);
+        if ((err >= 0) && (crc != hdr.part_entry_crc32)) {
+            err = FS_ERR_INVALID_FS;
+        }
+        if (err < 0) {
+            disk->part_count = 0;
+            disk->part_desc_max = 0;
+            return err;
+        }
+    }
+
+    disk->part_gpt = 1;
+    disk->gpt_header_sector = hdr_sector;
+    if (hdr_sector > disk->part_desc_max) {
+        disk->part_desc_max = hdr_sector;
+    }
+    return FS_ERR_OK;
 }
 
 /**
- * ȡָŵķϢ
- * ע⣬ò䣬豸ķṹб仯Ҳı䣬õĽͬ
+ * ޸GPTһͣ·鼰GPTͷCRC32
  * @param disk 洢豸
- * @param part Ϣ洢λ
- * @param part_no 
+ * @param hdr_sector GPTͷڵ
+ * @param entry_no 
+ * @param type_guid µGUID
+ * @param alternate_lba GPTͷм¼һGPTͷλ
  * @return
  */
-xfat_err_t xdisk_get_part(xdisk_t *disk, xdisk_part_t *xdisk_part, int part_no) {
-    int i;
-    int curr_no = -1;
-    mbr_part_t * mbr_part;
+static xfat_err_t gpt_set_entry_type(xdisk_t * disk, u32_t hdr_sector, u32_t entry_no,
+                    const u8_t * type_guid, u64_t * alternate_lba) {
+    u32_t per_sector, sector, crc;
+    gpt_header_t * hdr_buf;
     xfat_buf_t* disk_buf;
+    gpt_header_t hdr;
 
-	// ȡmbr
-	xfat_err_t err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
-	if (err < 0) {
-		return err;
-	}
-
-	// 4
-    mbr_part = ((mbr_t *)disk_buf->buf)->part_info;
-	for (i = 0; i < MBR_PRIMARY_PART_NR; i++, mbr_part++) {
-		if (mbr_part->system_id == FS_NOT_VALID) {
-			continue;
-        }
+    xfat_err_t err = gpt_read_header(disk, hdr_sector, &hdr);
+    if (err < 0) {
+        return err;
+    }
 
-		// չѯӷ
-		if (mbr_part->system_id == FS_EXTEND) {
-            u32_t count = 0;
-            err = disk_get_extend_part(disk, xdisk_part, mbr_part->relative_sectors, part_no - i, &count);
-            if (err < 0) {      // д
-                return err;
-            }
+    *alternate_lba = hdr.alternate_lba;
+    if (entry_no >= hdr.part_entry_count) {
+        return FS_ERR_PARAM;
+    }
+
+    per_sector = disk->sector_size / hdr.part_entry_size;
+    sector = (u32_t)hdr.part_entry_lba + entry_no / per_sector;
+    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, sector);
+    if (err < 0) {
+        return err;
+    }
+
+    memcpy(disk_buf->buf + (entry_no % per_sector) * hdr.part_entry_size, type_guid, 16);
+    err = xfat_bpool_write_sector(to_obj(disk), disk_buf, 0);
+    if (err < 0) {
+        return err;
+    }
+
+    err = gpt_scan_entries(disk, &hdr, 0, &crc);
+    if (err < 0) {
+        return err;
+    }
+
+    // ʱGPTͷѱ滻棬¶ȡ
+    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, hdr_sector);
+    if (err < 0) {
+        return err;
+    }
+
+    hdr_buf = (gpt_header_t *)disk_buf->buf;
+    hdr_buf->part_entry_crc32 = crc;
+    hdr_buf->header_crc32 = 0;
+    hdr_buf->header_crc32 = xdisk_crc32(0, disk_buf->buf, hdr.header_size);
+    return xfat_bpool_write_sector(to_obj(disk), disk_buf, 0);
+}
+
+/**
+ * GPTͣFATͶӦݷǻݻEFIϵͳʱ޸
+ * GPT£ʱõGPTʧʱشһʧܺ
+ * @param disk 洢豸
+ * @param ent е
+ * @param type 
+ * @return
+ */
+static xfat_err_t disk_set_gpt_type(xdisk_t * disk, const xdisk_part_ent_t * ent, xfs_type_t type) {
+    u64_t alternate_lba, unused_lba;
+    xfat_buf_t* disk_buf;
+    gpt_header_t hdr;
+    u32_t entry_no;
+    u8_t * type_guid;
+
+    xfat_err_t err;
+
+    if ((type != FS_FAT32) && (type != FS_WIN95_FAT32_0) && (type != FS_WIN95_FAT32_1)) {
+        return FS_ERR_PARAM;
+    }
+
+    err = gpt_read_header(disk, disk->gpt_header_sector, &hdr);
+    if (err < 0) {
+        return err;
+    }
+
+    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, ent->desc_sector);
+    if (err < 0) {
+        return err;
+    }
+
+    type_guid = disk_buf->buf + ent->desc_index * hdr.part_entry_size;
+    if (gpt_type_is_fat(type_guid)) {
+        return FS_ERR_OK;
+    }
+
+    entry_no = (ent->desc_sector - (u32_t)hdr.part_entry_lba) * (disk->sector_size / hdr.part_entry_size) + ent->desc_index;
+    err = gpt_set_entry_type(disk, disk->gpt_header_sector, entry_no, gpt_type_basic_data, &alternate_lba);
+    if (err < 0) {
+        return err;
+    }
+
+    if (alternate_lba < disk->total_sector) {
+        gpt_set_entry_type(disk, (u32_t)alternate_lba, entry_no, gpt_type_basic_data, &unused_lba);
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * MBRչGPT
+ * MBRе˳ţչµӷռøչλõţGPT̰˳
+ * @param disk 洢豸
+ * @return
+ */
+static xfat_err_t disk_scan_part(xdisk_t * disk) {
+    mbr_part_t mbr_part[MBR_PRIMARY_PART_NR];
+    xfat_buf_t* disk_buf;
+    xfat_err_t err;
+    int i;
+
+    disk->part_valid = 0;
+    disk->part_gpt = 0;
+    disk->part_count = 0;
+    disk->part_desc_max = 0;
+
+    // ֻȡһmbrƳٱչصmbr滻
+    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
+    if (err < 0) {
+        return err;
+    }
+    memcpy(mbr_part, ((mbr_t *)disk_buf->buf)->part_info, sizeof(mbr_part));
+
+    // бΪGPṬGPTЧʱ԰MBR
+    for (i = 0; i < MBR_PRIMARY_PART_NR; i++) {
+        if ((mbr_part[i].system_id == FS_GPT) && (disk_scan_gpt(disk) >= 0)) {
+            disk->part_valid = 1;
+            return FS_ERR_OK;
+        }
+    }
 
-            if (err == FS_ERR_OK) {      // ҵ
-                return FS_ERR_OK;
-            } else {                    // δҵӼ
-                curr_no += count;
+    for (i = 0; i < MBR_PRIMARY_PART_NR; i++) {
+        if (mbr_part[i].system_id == FS_NOT_VALID) {
+            continue;
+        }
 
-                // todo: չĲѯƻ˵ǰȡ壬Դ˴ٴζȡ
-                err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
-                if (err < 0) {
-                    return err;
-                }
+        if (mbr_part[i].system_id == FS_EXTEND) {
+            err = disk_scan_extend_part(disk, mbr_part[i].relative_sectors);
+            if (err < 0) {
+                return err;
             }
         } else {
-		    // ҵϢ
-            if (++curr_no == part_no) {
-                xdisk_part->type = mbr_part->system_id;
-                xdisk_part->start_sector = mbr_part->relative_sectors;
-                xdisk_part->total_sector = mbr_part->total_sectors;
-                xdisk_part->relative_sector = mbr_part->relative_sectors;
-                xdisk_part->disk = disk;
-                return FS_ERR_OK;
-            }
+            disk_part_add(disk, mbr_part[i].relative_sectors, mbr_part[i].total_sectors,
+                    mbr_part[i].relative_sectors, mbr_part[i].system_id, 0, i);
         }
-	}
+    }
 
-	return FS_ERR_NONE;
+    disk->part_valid = 1;
+    return FS_ERR_OK;
 }
 
-static xfat_err_t set_ext_part_type(xdisk_part_t* part, u32_t ext_start_sector, xfs_type_t type) {
-    xfat_err_t err = FS_ERR_OK;
-    u32_t start_sector = ext_start_sector;
-    xdisk_t* disk = part->disk;
+/**
+ * ȷЧʧЧʱ½
+ * @param disk 洢豸
+ * @return
+ */
+static xfat_err_t disk_check_part(xdisk_t * disk) {
+    if (disk->part_valid) {
+        return FS_ERR_OK;
+    }
 
-    do {
-        mbr_part_t* ext_part;
-        xfat_buf_t* disk_buf;
+    return disk_scan_part(disk);
+}
 
-        err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, start_sector);
-        if (err < 0) {
-            return err;
-        }
+/**
+ * ڵֱд룺ʧЧ»и
+ * ֱд벻棬µĻؽʱɵķ
+ * @param disk 洢豸
+ * @param buffer дݣΪ0ʾдȫ0
+ * @param start_sector дʼ
+ * @param sector дķ
+ */
+static void disk_part_sync_sector(xdisk_t * disk, const u8_t * buffer, u32_t start_sector, u32_t sector) {
+    const u8_t * src = buffer ? buffer + (sector - start_sector) * disk->sector_size : (const u8_t *)0;
+    xfat_buf_t * buf;
 
-        ext_part = ((mbr_t*)disk_buf->buf)->part_info;
-        if (ext_part->system_id == FS_NOT_VALID) {
-            err = FS_ERR_EOF;
-            break;
-        }
+    disk->part_valid = 0;
+    if (xfat_bpool_find(to_obj(disk), &buf, sector) < 0) {
+        return;
+    }
 
-        if (start_sector + ext_part->relative_sectors == part->start_sector) {
-            ext_part->system_id = type;
+    // ڻдľǸû
+    if (src == buf->buf) {
+        return;
+    }
 
-            err = xfat_bpool_write_sector(to_obj(disk), disk_buf, 0);
-            return err;
-        }
+    if (src) {
+        memcpy(buf->buf, src, disk->sector_size);
+    } else {
+        memset(buf->buf, 0, disk->sector_size);
+    }
+}
 
-        if ((++ext_part)->system_id != FS_EXTEND) { // ޺δҵ, 
-            err = FS_ERR_EOF;
-            break;
+/**
+ * ֱдǰãдMBREBRGPTͷ򺬷ʱʹʧЧ
+ * ʧЧ԰м¼ĸλü飬ֱؽ
+ * @param disk 洢豸
+ * @param buffer дݣΪ0ʾдȫ0
+ * @param start_sector дʼ
+ * @param count д
+ */
+static void disk_part_on_write(xdisk_t * disk, const u8_t * buffer, u32_t start_sector, u32_t count) {
+    u32_t i;
+
+    if (start_sector > disk->part_desc_max) {
+        return;
+    }
+
+    if (start_sector == 0) {
+        disk_part_sync_sector(disk, buffer, start_sector, 0);
+    }
+
+    if (disk->part_gpt && (start_sector <= disk->gpt_header_sector)
+        && (disk->gpt_header_sector - start_sector < count)) {
+        disk_part_sync_sector(disk, buffer, start_sector, disk->gpt_header_sector);
+    }
+
+    for (i = 0; i < disk->part_count; i++) {
+        u32_t desc_sector = disk->part_tbl[i].desc_sector;
+
+        if ((desc_sector >= start_sector) && (desc_sector - start_sector < count)) {
+            disk_part_sync_sector(disk, buffer, start_sector, desc_sector);
         }
+    }
+}
 
-        start_sector = ext_start_sector + ext_part->relative_sectors;
-    } while (1);
+/**
+ * ȡ豸ܵķ
+ * @param disk ѯĴ洢豸
+ * @param count 洢λ
+ * @return
+ */
+xfat_err_t xdisk_get_part_count(xdisk_t *disk, u32_t *count) {
+    xfat_err_t err = disk_check_part(disk);
+    if (err < 0) {
+        return err;
+    }
 
-    return err;
+    *count = disk->part_count;
+	return FS_ERR_OK;
+}
+
+/**
+ * ȡָŵķϢ
+ * ע⣬ò䣬豸ķṹб仯Ҳı䣬õĽͬ
+ * @param disk 洢豸
+ * @param part Ϣ洢λ
+ * @param part_no 
+ * @return
+ */
+xfat_err_t xdisk_get_part(xdisk_t *disk, xdisk_part_t *xdisk_part, int part_no) {
+    xdisk_part_ent_t * ent;
+
+    xfat_err_t err = disk_check_part(disk);
+    if (err < 0) {
+        return err;
+    }
+
+    if ((part_no < 0) || ((u32_t)part_no >= disk->part_count)) {
+        return FS_ERR_NONE;
+    }
+
+    ent = disk->part_tbl + part_no;
+    xdisk_part->type = (xfs_type_t)ent->type;
+    xdisk_part->start_sector = ent->start_sector;
+    xdisk_part->total_sector = ent->total_sector;
+    xdisk_part->relative_sector = ent->relative_sector;
+    xdisk_part->disk = disk;
+	return FS_ERR_OK;
 }
 
 /**
  * ָʽ
+ * ɷֱҵ÷MBREBRGPT޸ĺʧЧ
  * @param part
  * @param type
  * @return
  */
 xfat_err_t xdisk_set_part_type(xdisk_part_t* part, xfs_type_t type) {
-    xfat_err_t err = FS_ERR_OK;
-    int i;
-    mbr_part_t* mbr_part;
     xdisk_t* disk = part->disk;
+    xdisk_part_ent_t * ent;
     xfat_buf_t* disk_buf;
+    u32_t i;
 
-    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
+    xfat_err_t err = disk_check_part(disk);
     if (err < 0) {
         return err;
     }
 
-    mbr_part = ((mbr_t*)disk_buf->buf)->part_info;
-    for (i = 0; i < MBR_PRIMARY_PART_NR; i++, mbr_part++) {
-        if (mbr_part->system_id == FS_NOT_VALID) {
-            continue;
+    for (i = 0, ent = disk->part_tbl; i < disk->part_count; i++, ent++) {
+        if (ent->start_sector == part->start_sector) {
+            break;
         }
+    }
 
-        // չѯӷ
-        if (mbr_part->system_id == FS_EXTEND) {
-            u32_t count = 0;
-            err = set_ext_part_type(part, mbr_part->relative_sectors, type);
-            if (err < 0) {
-                return err;
-            }
+    if (i >= disk->part_count) {
+        return FS_ERR_EOF;
+    }
 
-            if (err != FS_ERR_EOF) {
-                return FS_ERR_OK;
-            }
+    if (disk->part_gpt) {
+        err = disk_set_gpt_type(disk, ent, type);
+        disk->part_valid = 0;
+        return err;
+    }
 
-            // todo: չĲѯƻ˵ǰȡ壬Դ˴ٴζȡ
-            err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, 0);
-            if (err < 0) {
-                return err;
-            }
-        } else if (mbr_part->relative_sectors == part->start_sector) {
-            mbr_part->system_id = type;
-                
-            err = xfat_bpool_write_sector(to_obj(disk), disk_buf, 0);
-            return err;
-        }
+    err = xfat_bpool_read_sector(to_obj(disk), &disk_buf, ent->desc_sector);
+    if (err < 0) {
+        return err;
     }
 
-    return err;
+    ((mbr_t*)disk_buf->buf)->part_info[ent->desc_index].system_id = type;
+    disk->part_valid = 0;
+    return xfat_bpool_write_sector(to_obj(disk), disk_buf, 0);
 }
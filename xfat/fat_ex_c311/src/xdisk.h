@@ -20,6 +20,7 @@ typedef enum {
     FS_EXTEND = 0x05,               // չ
     FS_WIN95_FAT32_0 = 0xB,         // FAT32
     FS_WIN95_FAT32_1 = 0xC,         // FAT32
+    FS_GPT = 0xEE,                  // GPTıGPTͲFATķҲԴ˱ʾ
 }xfs_type_t;
 
 #pragma pack(1)
@@ -51,11 +52,72 @@ typedef  struct _mbr_t {
 	u8_t boot_sig[2];               // ־
 }mbr_t;
 
+#define GPT_HEADER_SECTOR       1                   // GPTͷڵ
+#define GPT_HEADER_SIZE_MIN     92                  // GPTͷСֽ
+#define GPT_ENTRY_SIZE_MIN      128                 // Сֽ
+
+/**
+ * GPTͷֶξΪС
+ */
+typedef struct _gpt_header_t {
+    u8_t signature[8];              // ־"EFI PART"
+    u32_t revision;                 // 汾
+    u32_t header_size;              // ͷֽ
+    u32_t header_crc32;             // ͷCRC32ʱֶΪ0
+    u32_t reserved;
+    u64_t my_lba;                   // ͷڵ
+    u64_t alternate_lba;            // һGPTͷڵͷָ򱸷ͷ
+    u64_t first_usable_lba;         // õʼ
+    u64_t last_usable_lba;          // õĽ
+    u8_t disk_guid[16];             // GUID
+    u64_t part_entry_lba;           // ʼ
+    u32_t part_entry_count;         // 
+    u32_t part_entry_size;          // ÿֽ
+    u32_t part_entry_crc32;         // CRC32
+}gpt_header_t;
+
+/**
+ * GPT
+ */
+typedef struct _gpt_entry_t {
+    u8_t type_guid[16];             // GUIDȫ0ʾδʹ
+    u8_t unique_guid[16];           // GUID
+    u64_t first_lba;                // ʼ
+    u64_t last_lba;                 // ڷ
+    u64_t attributes;               // 
+    u16_t name[36];                 // UTF-16LE
+}gpt_entry_t;
+
 #pragma pack()
 
+#define XDISK_SECTOR_SIZE_MIN       512             // ֵ֧СС
+#define XDISK_SECTOR_SIZE_MAX       4096            // ֵ֧С4Kԭ(4Kn)
+#define XDISK_ZERO_BUF_SIZE         (32 * 1024)     // ֧0ʱд0õĹС
+#define XDISK_PART_MAX              32              // ɼ¼ķչµӷķɼ
+
 // ǰ
 struct _xdisk_t;
 
+/**
+ * ɢ/ۼдеһλζӦ
+ */
+typedef struct _xdisk_vec_t {
+    u8_t * buffer;                  // ݻ
+    u32_t count;                    // öε
+}xdisk_vec_t;
+
+/**
+ * еһ
+ */
+typedef struct _xdisk_part_ent_t {
+    u32_t start_sector;             // 洢ʼĿ
+    u32_t total_sector;             // ܵĿ
+    u32_t relative_sector;          // ߼
+    u32_t desc_sector;              // ÷ķڵMBREBRGPT
+    u8_t desc_index;                // ڸķе
+    u8_t type;                      // ļϵͳ
+}xdisk_part_ent_t;
+
 /**
  * ӿ
  */
@@ -65,6 +127,15 @@ typedef struct _xdisk_driver_t {
     xfat_err_t (*curr_time) (struct _xdisk_t * disk, struct _xfile_time_t *timeinfo);
     xfat_err_t (*read_sector) (struct _xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
     xfat_err_t (*write_sector) (struct _xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
+    xfat_err_t (*read_sector_v) (struct _xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector);  // ɢΪ0
+    xfat_err_t (*write_sector_v) (struct _xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector); // ۼдΪ0
+    xfat_err_t (*sync) (struct _xdisk_t *disk);    // дͬʣΪ0
+    xfat_err_t (*discard) (struct _xdisk_t *disk, u32_t start_sector, u32_t count);    // ֪ͨ豸ѲʹãΪ0
+    xfat_err_t (*write_zeroes) (struct _xdisk_t *disk, u32_t start_sector, u32_t count);   // 0Ϊ0
+    xfat_err_t (*map_sector) (struct _xdisk_t *disk, u32_t start_sector, u32_t count, u8_t ** addr);   // ӳֱӷʣΪ0
+    xfat_err_t (*unmap_sector) (struct _xdisk_t *disk, u8_t * addr, u32_t start_sector, u32_t count);  // ӳ䣬Ϊ0
+    xfat_err_t (*submit_io) (struct _xdisk_t *disk, u8_t is_write, u8_t *buffer, u32_t start_sector, u32_t count); // ύ첽дΪ0
+    xfat_err_t (*wait_io) (struct _xdisk_t *disk);  // ȴύĶдɣе׸󣬿Ϊ0
 }xdisk_driver_t;
 
 /**
@@ -76,10 +147,20 @@ typedef struct _xdisk_t {
     const char * name;              // 豸
     u32_t sector_size;              // С
 	u32_t total_sector;             // ܵĿ
+    u32_t buf_align;                // ҪĻֽ0ʾҪopenʱ
     xdisk_driver_t * driver;        // ӿ
     void * data;                    // 豸Զ
 
     xfat_bpool_t bpool;		        // ̻棬ڷ
+    u32_t bpool_tick;               // 涨ʱдõʱӣxfat_bpool_tickƽ
+
+    // ʱMBRչ޸ķʧЧٴβѯʱؽ
+    xdisk_part_ent_t part_tbl[XDISK_PART_MAX];
+    u32_t part_count;               // еķ
+    u32_t part_desc_max;            // ֵд벻ֵʱǷʹʧЧ
+    u8_t part_valid;                // ǷЧ
+    u8_t part_gpt;                  // ǷGPT
+    u32_t gpt_header_sector;        // õGPTͷGPTʱΪͷ
 }xdisk_t;
 
 /**
@@ -101,7 +182,21 @@ xfat_err_t xdisk_get_part(xdisk_t *disk, xdisk_part_t *xdisk_part, int part_no);
 xfat_err_t xdisk_curr_time(xdisk_t *disk, struct _xfile_time_t *timeinfo);
 xfat_err_t xdisk_read_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
 xfat_err_t xdisk_write_sector(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_read_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector);
+xfat_err_t xdisk_write_sector_v(xdisk_t *disk, const xdisk_vec_t *vec, u32_t vec_count, u32_t start_sector);
 xfat_err_t xdisk_set_part_type(xdisk_part_t * part, xfs_type_t type);
+xfat_err_t xdisk_sync(xdisk_t * disk);
+xfat_err_t xdisk_discard(xdisk_t * disk, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_write_zeroes(xdisk_t * disk, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_map_sector(xdisk_t *disk, u32_t start_sector, u32_t count, u8_t ** addr);
+xfat_err_t xdisk_unmap_sector(xdisk_t *disk, u8_t * addr, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_submit_read(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_submit_write(xdisk_t *disk, u8_t *buffer, u32_t start_sector, u32_t count);
+xfat_err_t xdisk_wait_io(xdisk_t *disk);
+u32_t xdisk_crc32(u32_t crc, const void * data, u32_t size);
+
+#define xdisk_is_async(disk)        ((disk)->driver->submit_io != 0)
+#define xdisk_can_discard(disk)     ((disk)->driver->discard != 0)
 
 #endif
 
@@ -15,6 +15,8 @@
 
 #define XFAT_MAX(a, b) ((a) > (b) ? (a) : (b))
 
+#define XFAT_RSVD_BYTES     (8478 * 512)        // ʽʱĴССΪ
+
 // õ...ļ             "12345678ext"
 #define DOT_FILE                ".          "
 #define DOT_DOT_FILE            "..         "
@@ -23,6 +25,7 @@
 #define is_path_end(path)       (((path) == 0) || (*path == '\0'))      // ж·ǷΪ
 #define file_get_disk(file)     ((file)->xfat->disk_part->disk)         // ȡdiskṹ
 #define xfat_get_disk(xfat)     ((xfat)->disk_part->disk)               // ȡdiskṹ
+#define fat_entry_count(xfat)   ((xfat)->fat_tbl_sectors * xfat_get_disk(xfat)->sector_size / sizeof(cluster32_t))  // ÿFATı
 #define to_sector(disk, offset)     ((offset) / (disk)->sector_size)    // ϡתΪ
 #define to_sector_offset(disk, offset)   ((offset) % (disk)->sector_size)   // ȡеƫ
 #define to_sector_addr(disk, offset)    ((offset) / (disk)->sector_size * (disk)->sector_size)  // ȡOffsetʼַ
@@ -67,12 +70,8 @@ void xfat_list_init (void) {
  * @param xfat ӵxfat
  */
 void xfat_list_add (xfat_t * xfat) {
-    if (xfat_list == (xfat_t *)0) {
-        xfat_list = xfat;
-    } else {
-        xfat->next = xfat_list;
-        xfat_list = xfat;
-    }
+    xfat->next = xfat_list;
+    xfat_list = xfat;
 }
 
 /**
@@ -166,6 +165,11 @@ xfat_err_t xfat_init(void) {
 static xfat_err_t parse_fat_header (xfat_t * xfat, dbr_t * dbr) {
     xdisk_part_t * xdisk_part = xfat->disk_part;
 
+    // žԴ̵ΪλߵСһʱ޷
+    if (dbr->bpb.BPB_BytsPerSec != xdisk_part->disk->sector_size) {
+        return FS_ERR_INVALID_FS;
+    }
+
     // DBRõĲ
     xfat->root_cluster = dbr->fat32.BPB_RootClus;
     xfat->fat_tbl_sectors = dbr->fat32.BPB_FATSz32;
@@ -261,6 +265,15 @@ static xfat_err_t load_cluster_free_info(xfat_t* xfat) {
     return err;
 }
 
+/**
+ * дϢдFSInfo䱸
+ * @param disk ڵĴ洢豸
+ * @param total_free д
+ * @param next_free һô
+ * @param fsinfo_sector FSInfoΪ̵ľ
+ * @param backup_sector FSInfoƫ
+ * @return
+ */
 static xfat_err_t save_cluster_free_info(xdisk_t * disk, u32_t total_free, u32_t next_free,
     u32_t fsinfo_sector, u32_t backup_sector) {
     xfat_err_t err;
@@ -273,7 +286,7 @@ static xfat_err_t save_cluster_free_info(xdisk_t * disk, u32_t total_free, u32_t
     }
     fsinfo = (fsinto_t*)buf->buf;
 
-    memset(fsinfo, 0, sizeof(fsinto_t));
+    memset(fsinfo, 0, disk->sector_size);    // 512ֽڵಿҲ0
 
     fsinfo->FSI_LoadSig = 0x41615252;
     fsinfo->FSI_StrucSig = 0x61417272;
@@ -296,6 +309,164 @@ static xfat_err_t save_cluster_free_info(xdisk_t * disk, u32_t total_free, u32_t
     return FS_ERR_OK;
 }
 
+/**
+ * FAT޸λͼУsectorʼҵһ״̬Ϊdirty
+ * @param xfat xfatṹ
+ * @param sector ʼҵFATʼ
+ * @param dirty 1޸ĵ0δ޸ĵ
+ * @return ҵûʱFAT
+ */
+static u32_t fat_mirror_find(xfat_t * xfat, u32_t sector, u8_t dirty) {
+    while (sector < xfat->fat_tbl_sectors) {
+        u32_t bits = xfat->fat_dirty[sector / 32];
+
+        if (!dirty) {
+            bits = ~bits;
+        }
+
+        // жûʱһ
+        bits >>= sector % 32;
+        if (bits == 0) {
+            sector = (sector / 32 + 1) * 32;
+            continue;
+        }
+
+        while (!(bits & 1)) {
+            bits >>= 1;
+            sector++;
+        }
+        break;
+    }
+
+    return (sector < xfat->fat_tbl_sectors) ? sector : xfat->fat_tbl_sectors;
+}
+
+/**
+ * FAT޸ĹдFAT
+ * FATŴСд룬޸ϲΪһд
+ * @param xfat xfatṹ
+ * @return
+ */
+static xfat_err_t fat_mirror_flush(xfat_t * xfat) {
+    xdisk_t * disk = xfat_get_disk(xfat);
+    u32_t i;
+
+    if ((xfat->fat_mirror == (cluster32_t *)0) || (xfat->fat_dirty_count == 0)) {
+        return FS_ERR_OK;
+    }
+
+    for (i = 0; i < xfat->fat_tbl_nr; i++) {
+        u32_t tbl_start = xfat->fat_start_sector + i * xfat->fat_tbl_sectors;
+        u32_t sector = fat_mirror_find(xfat, 0, 1);
+
+        while (sector < xfat->fat_tbl_sectors) {
+            u32_t count = fat_mirror_find(xfat, sector, 0) - sector;
+            xfat_err_t err;
+
+            err = xdisk_write_sector(disk, (u8_t *)xfat->fat_mirror + sector * disk->sector_size, tbl_start + sector, count);
+            if (err < 0) {
+                return err;
+            }
+
+            sector = fat_mirror_find(xfat, sector + count, 1);
+        }
+    }
+
+    memset(xfat->fat_dirty, 0, (xfat->fat_tbl_sectors + 31) / 32 * sizeof(u32_t));
+    xfat->fat_dirty_count = 0;
+    return FS_ERR_OK;
+}
+
+/**
+ * ȡ͵Ϊ0λ
+ * @param bits ȫΪ1
+ * @return
+ */
+static u32_t lowest_zero_bit(u32_t bits) {
+    static const u8_t debruijn_tbl[32] = {
+        0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+        31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+    };
+
+    // ֻ͵0λde Bruijnвõ
+    bits = ~bits & (bits + 1);
+    return debruijn_tbl[(u32_t)(bits * 0x077CB531u) >> 27];
+}
+
+/**
+ * ¿дλͼָصռ״̬ͬʱάժҪ
+ * @param xfat xfatṹ
+ * @param cluster غţСλͼǵĴ
+ * @param used Ƿռ
+ */
+static void free_bitmap_update(xfat_t * xfat, u32_t cluster, u8_t used) {
+    u32_t word = cluster / 32;
+    u32_t mask = 1u << (cluster % 32);
+
+    if (used) {
+        xfat->free_bitmap[word] |= mask;
+        if (xfat->free_bitmap[word] == 0xFFFFFFFF) {
+            xfat->free_summary[word / 32] |= 1u << (word % 32);
+        }
+    } else {
+        xfat->free_bitmap[word] &= ~mask;
+        xfat->free_summary[word / 32] &= ~(1u << (word % 32));
+    }
+}
+
+/**
+ * ڿдλͼУstartʼҵһдأ
+ * ʼ֮ȰժҪȫռõ֣ÿαȽ32ּ1024
+ * @param xfat xfatṹ
+ * @param start ʼҵĴغ
+ * @return ҵĴغţûʱCLUSTER_INVALID
+ */
+static u32_t free_bitmap_search(xfat_t * xfat, u32_t start) {
+    u32_t words = (xfat->free_bitmap_count + 31) / 32;
+    u32_t word = start / 32;
+    u32_t bits;
+
+    if (start >= xfat->free_bitmap_count) {
+        return CLUSTER_INVALID;
+    }
+
+    bits = xfat->free_bitmap[word] | ((1u << (start % 32)) - 1);
+    if (bits != 0xFFFFFFFF) {
+        return word * 32 + lowest_zero_bit(bits);
+    }
+
+    word++;
+    while (word < words) {
+        u32_t summary = xfat->free_summary[word / 32] | ((1u << (word % 32)) - 1);
+
+        if (summary == 0xFFFFFFFF) {
+            word = (word / 32 + 1) * 32;
+            continue;
+        }
+
+        // λͼĩβ֮ժҪоΪռãԽ
+        word = word / 32 * 32 + lowest_zero_bit(summary);
+        return word * 32 + lowest_zero_bit(xfat->free_bitmap[word]);
+    }
+
+    return CLUSTER_INVALID;
+}
+
+/**
+ * ڿдλͼУstartʼҵһдأĩβƵͷ
+ * @param xfat xfatṹ
+ * @param start ʼҵĴغ
+ * @return ҵĴغţûʱCLUSTER_INVALID
+ */
+static u32_t free_bitmap_find(xfat_t * xfat, u32_t start) {
+    u32_t cluster = free_bitmap_search(xfat, start);
+
+    if ((cluster == CLUSTER_INVALID) && (start != 0)) {
+        cluster = free_bitmap_search(xfat, 0);
+    }
+    return cluster;
+}
+
 /**
  * ʼFAT
  * @param xfat xfatṹ
@@ -310,12 +481,16 @@ xfat_err_t xfat_mount(xfat_t * xfat, xdisk_part_t * xdisk_part, const char * mou
 
     xfat_obj_init(&xfat->obj, XFAT_OBJ_FAT);
 
-    err = xfat_bpool_init(&xfat->obj, 0, 0, 0);
+    err = xfat_bpool_init(&xfat->obj, 0, 0, 0, 0);
     if (err < 0) {
         return err;
     }
 
     xfat->disk_part = xdisk_part;
+    xfat->fat_mirror = (cluster32_t *)0;
+    xfat->fat_dirty = (u32_t *)0;
+    xfat->fat_dirty_count = 0;
+    xfat->free_bitmap = (u32_t *)0;
 
     err = xfat_bpool_read_sector(to_obj(xfat), &buf, xdisk_part->start_sector);
     if (err < 0) {
@@ -344,28 +519,213 @@ xfat_err_t xfat_mount(xfat_t * xfat, xdisk_part_t * xdisk_part, const char * mou
  * @param xfat
  */
 void xfat_unmount(xfat_t * xfat) {
+    xdisk_part_t* part = xfat->disk_part;
+
+    fat_mirror_flush(xfat);
+    xfat->fat_mirror = (cluster32_t *)0;
+    xfat->free_bitmap = (u32_t *)0;
+
     save_cluster_free_info(xfat_get_disk(xfat), xfat->cluster_total_free,
-                    xfat->cluster_next_free, xfat->fsi_sector, xfat->backup_sector);
+                    xfat->cluster_next_free, part->start_sector + xfat->fsi_sector, xfat->backup_sector);
     xfat_bpool_flush(to_obj(xfat));
+
+    // Ҳܻڴ̻
+    xfat_bpool_flush_sectors(to_obj(xfat), part->start_sector, part->total_sector);
+    xfat_bpool_release(to_obj(xfat));
     xfat_list_remove(xfat);
 }
 
 xfat_err_t xfat_set_buf(xfat_t* xfat, u8_t* buf, u32_t size) {
     xfat_err_t err;
+
+    // ϵĸعظ棬ֻͷԭеĻ
+    err = xfat_bpool_release(to_obj(xfat));
+    if (err < 0) {
+        return err;
+    }
+
+    err = xfat_bpool_init(to_obj(xfat), xfat_get_disk(xfat)->sector_size, buf, size, xfat_get_disk(xfat)->buf_align);
+    return err;
+}
+
+/**
+ * ÷滻ԣxfat_set_buf֮
+ * @param xfat
+ * @param policy
+ * @return
+ */
+xfat_err_t xfat_set_buf_policy(xfat_t* xfat, xfat_buf_policy_t policy) {
+    return xfat_bpool_set_policy(to_obj(xfat), policy);
+}
+
+/**
+ * FATڴ棬֮дFATֻڴ棬پ
+ * ޸Ĺxfat_syncʱдFATFATڴķ
+ * @param xfat
+ * @param buf õĿռ䣬4ֽڶ룬СΪXFAT_FAT_MIRROR_SIZE(xfat->fat_tbl_sectors, С)Ϊ0ʱдͣþ
+ * @param size bufֽ
+ * @return
+ */
+xfat_err_t xfat_set_fat_mirror(xfat_t* xfat, u8_t* buf, u32_t size) {
+    xdisk_t * disk = xfat_get_disk(xfat);
+    u32_t fat_bytes = xfat->fat_tbl_sectors * disk->sector_size;
+    u32_t all_sectors = xfat->fat_tbl_sectors * xfat->fat_tbl_nr;
+    xfat_err_t err;
+
+    err = fat_mirror_flush(xfat);
+    if (err < 0) {
+        return err;
+    }
+    xfat->fat_mirror = (cluster32_t *)0;
+
+    if (buf == (u8_t *)0) {
+        return FS_ERR_OK;
+    }
+
+    if ((size_t)buf & (sizeof(u32_t) - 1)) {
+        return FS_ERR_PARAM;
+    }
+
+    if (size < XFAT_FAT_MIRROR_SIZE(xfat->fat_tbl_sectors, disk->sector_size)) {
+        return FS_ERR_NO_BUFFER;
+    }
+
+    // еFATȻд
+    err = xfat_bpool_flush_sectors(to_obj(xfat), xfat->fat_start_sector, all_sectors);
+    if (err < 0) {
+        return err;
+    }
+
+    err = xdisk_read_sector(disk, buf, xfat->fat_start_sector, xfat->fat_tbl_sectors);
+    if (err < 0) {
+        return err;
+    }
+
+    // ֱ֮д̣еFATʱȫ
+    err = xfat_bpool_invalid_sectors(to_obj(xfat), xfat->fat_start_sector, all_sectors);
+    if (err < 0) {
+        return err;
+    }
+
+    xfat->fat_dirty = (u32_t *)(buf + fat_bytes);
+    memset(xfat->fat_dirty, 0, (xfat->fat_tbl_sectors + 31) / 32 * sizeof(u32_t));
+    xfat->fat_dirty_count = 0;
+    xfat->fat_mirror = (cluster32_t *)buf;
+    return FS_ERR_OK;
+}
+
+/**
+ * FATдλͼ֮ʱλͼвңFAT
+ * λͼFAT޸ͬ£FATʱӾ򾭻ȡFAT
+ * @param xfat
+ * @param buf λͼõĿռ䣬4ֽڶ룬СΪXFAT_FREE_BITMAP_SIZE(xfat->fat_tbl_sectors, С)Ϊ0ʱͣλͼ
+ * @param size bufֽ
+ * @return
+ */
+xfat_err_t xfat_set_free_bitmap(xfat_t* xfat, u8_t* buf, u32_t size) {
+    xdisk_t * disk = xfat_get_disk(xfat);
+    u32_t entry_per_sector = disk->sector_size / sizeof(cluster32_t);
+    u32_t words = XFAT_FREE_BITMAP_WORDS(xfat->fat_tbl_sectors, disk->sector_size);
+    u32_t summary_words = (words + 31) / 32;
+    u32_t data_offset = cluster_fist_sector(xfat, 2) - xfat->disk_part->start_sector;
+    u32_t cluster_end, sector, i;
+    u32_t * bitmap, * summary;
+
+    xfat->free_bitmap = (u32_t *)0;
+    if (buf == (u8_t *)0) {
+        return FS_ERR_OK;
+    }
+
+    if ((size_t)buf & (sizeof(u32_t) - 1)) {
+        return FS_ERR_PARAM;
+    }
+
+    if (size < XFAT_FREE_BITMAP_SIZE(xfat->fat_tbl_sectors, disk->sector_size)) {
+        return FS_ERR_NO_BUFFER;
+    }
+
+    // FATĩβܶһЩû֮ӦĴ
+    cluster_end = (xfat->total_sectors > data_offset) ? (xfat->total_sectors - data_offset) / xfat->sec_per_cluster + 2 : 2;
+    if (cluster_end > fat_entry_count(xfat)) {
+        cluster_end = fat_entry_count(xfat);
+    }
+
+    bitmap = (u32_t *)buf;
+    summary = bitmap + words;
+    memset(bitmap, 0, words * sizeof(u32_t));
+    for (sector = 0; (sector < xfat->fat_tbl_sectors) && (sector * entry_per_sector < cluster_end); sector++) {
+        u32_t base = sector * entry_per_sector;
+        cluster32_t * entry;
+
+        if (xfat->fat_mirror) {
+            entry = xfat->fat_mirror + base;
+        } else {
+            xfat_buf_t * fat_buf;
+            xfat_err_t err = xfat_bpool_read_sector(to_obj(xfat), &fat_buf, xfat->fat_start_sector + sector);
+            if (err < 0) {
+                return err;
+            }
+            entry = (cluster32_t *)fat_buf->buf;
+        }
+
+        for (i = 0; i < entry_per_sector; i++) {
+            if (entry[i].s.next != CLUSTER_FREE) {
+                bitmap[(base + i) / 32] |= 1u << ((base + i) % 32);
+            }
+        }
+    }
+
+    // Ĵ01֮ıΪռ
+    bitmap[0] |= 0x3;
+    for (i = cluster_end; i < words * 32; i++) {
+        bitmap[i / 32] |= 1u << (i % 32);
+    }
+
+    // ȫռõ֣Լλͼĩβ֣֮ժҪ1
+    memset(summary, 0, summary_words * sizeof(u32_t));
+    for (i = 0; i < summary_words * 32; i++) {
+        if ((i >= words) || (bitmap[i] == 0xFFFFFFFF)) {
+            summary[i / 32] |= 1u << (i % 32);
+        }
+    }
+
+    xfat->free_summary = summary;
+    xfat->free_bitmap_count = cluster_end;
+    xfat->free_bitmap = bitmap;
+    return FS_ERR_OK;
+}
+
+/**
+ * ޸Ĺд洢ʣFAT񡢿дϢ
+ * @param xfat
+ * @return
+ */
+xfat_err_t xfat_sync(xfat_t* xfat) {
     xdisk_part_t* part = xfat->disk_part;
+    xfat_err_t err;
 
-    err = xfat_bpool_flush_sectors(to_obj(xfat), part->start_sector, part->total_sector);
+    err = fat_mirror_flush(xfat);
     if (err < 0) {
         return err;
     }
 
-    err = xfat_bpool_invalid_sectors(to_obj(xfat), part->start_sector, part->total_sector);
+    err = save_cluster_free_info(xfat_get_disk(xfat), xfat->cluster_total_free,
+                    xfat->cluster_next_free, part->start_sector + xfat->fsi_sector, xfat->backup_sector);
     if (err < 0) {
         return err;
     }
 
-    err = xfat_bpool_init(to_obj(xfat), xfat_get_disk(xfat)->sector_size, buf, size);
-    return err;
+    err = xfat_bpool_flush(to_obj(xfat));
+    if (err < 0) {
+        return err;
+    }
+
+    err = xfat_bpool_flush_sectors(to_obj(xfat), part->start_sector, part->total_sector);
+    if (err < 0) {
+        return err;
+    }
+
+    return xdisk_sync(xfat_get_disk(xfat));
 }
 
 
@@ -425,7 +785,7 @@ static u32_t cal_fat_tbl_sectors (dbr_t * dbr, xdisk_part_t * xdisk_part, xfat_f
  */
 static u32_t get_default_cluster_size (xdisk_part_t * xdisk_part) {
     u32_t sector_size = xdisk_part->disk->sector_size;
-    u64_t part_size = xdisk_part->total_sector * sector_size;
+    u64_t part_size = (u64_t)xdisk_part->total_sector * sector_size;
     u32_t cluster_size;
 
     if (part_size <= XFAT_MB(64)) {
@@ -482,7 +842,7 @@ static xfat_err_t create_dbr (xdisk_part_t * xdisk_part, xfat_fmt_ctrl_t * ctrl,
     strncpy((char *)dbr->bpb.BS_OEMName, "XFAT SYS", 8);
     dbr->bpb.BPB_BytsPerSec = disk->sector_size;
     dbr->bpb.BPB_SecPerClus = to_sector(disk, cluster_size);
-    dbr->bpb.BPB_RsvdSecCnt = 8478;         // ̶ֵΪ32ʵʲԣΪ6182
+    dbr->bpb.BPB_RsvdSecCnt = to_sector(disk, XFAT_RSVD_BYTES);  // ̶ֵΪ32ʵʲԣΪ6182
     dbr->bpb.BPB_NumFATs = 2;               // ̶Ϊ2
     dbr->bpb.BPB_RootEntCnt = 0;            // FAT32δ
     dbr->bpb.BPB_TotSec16 = 0;              // FAT32δ
@@ -557,7 +917,7 @@ int xfat_is_fs_supported(xfs_type_t type) {
  * @return
  */
 static xfat_err_t create_fat_table (xfat_fmt_info_t * fmt_info, xdisk_part_t * xdisk_part, xfat_fmt_ctrl_t * ctrl) {
-    u32_t i, j;
+    u32_t i;
     xdisk_t * disk = xdisk_part->disk;
     cluster32_t * fat_buffer;
     xfat_err_t err = FS_ERR_OK;
@@ -585,14 +945,15 @@ static xfat_err_t create_fat_table (xfat_fmt_info_t * fmt_info, xdisk_part_t * x
             return err;
         }
 
-        // дĴ
-        fat_buffer[0].v = fat_buffer[1].v = fat_buffer[2].v = 0;
-        for (j = 1; j < fmt_info->fat_sectors; j++) {
-            ++buf->sector_no;
-            err = xfat_bpool_write_sector(to_obj(disk), buf, 1);
-            if (err  < 0) {
-                return err;
-            }
+        // ȫ0
+        err = xfat_bpool_invalid_sectors(to_obj(disk), buf->sector_no + 1, fmt_info->fat_sectors - 1);
+        if (err < 0) {
+            return err;
+        }
+
+        err = xdisk_write_zeroes(disk, buf->sector_no + 1, fmt_info->fat_sectors - 1);
+        if (err < 0) {
+            return err;
         }
     }
     return err;
@@ -607,7 +968,6 @@ static xfat_err_t create_fat_table (xfat_fmt_info_t * fmt_info, xdisk_part_t * x
  */
 static xfat_err_t create_root_dir(xfat_fmt_info_t * fmt_info, xdisk_part_t * xdisk_part, xfat_fmt_ctrl_t * ctrl) {
     xfat_err_t err;
-    int i;
     xdisk_t * xdisk = xdisk_part->disk;
     u32_t data_sector = fmt_info->rsvd_sectors             // 
             + (fmt_info->fat_count * fmt_info->fat_sectors)  // FAT
@@ -615,27 +975,29 @@ static xfat_err_t create_root_dir(xfat_fmt_info_t * fmt_info, xdisk_part_t * xdi
     diritem_t * diritem;
     xfat_buf_t * buf;
 
-    err = xfat_bpool_alloc(to_obj(xdisk), &buf, xdisk_part->start_sector + data_sector);
+    // Ŀ¼ڵĴ
+    err = xfat_bpool_invalid_sectors(to_obj(xdisk), xdisk_part->start_sector + data_sector, fmt_info->sec_per_cluster);
     if (err < 0) {
         return err;
     }
-    diritem = (diritem_t*)buf->buf;
 
-    // Ŀ¼ڵĴ
-    memset(buf->buf, 0, xdisk->sector_size);
-    for (i = 0; i < fmt_info->sec_per_cluster; i++, buf->sector_no++) {
-        err = xfat_bpool_write_sector(to_obj(xdisk), buf, 1);
-        if (err < 0) {
-            return err;
-        }
+    err = xdisk_write_zeroes(xdisk, xdisk_part->start_sector + data_sector, fmt_info->sec_per_cluster);
+    if (err < 0) {
+        return err;
     }
 
     // Ŀ¼
     if (ctrl->vol_name) {
+        err = xfat_bpool_alloc(to_obj(xdisk), &buf, xdisk_part->start_sector + data_sector);
+        if (err < 0) {
+            return err;
+        }
+
+        diritem = (diritem_t*)buf->buf;
+        memset(buf->buf, 0, xdisk->sector_size);
         diritem_init_default(diritem, xdisk, 0, ctrl->vol_name ? ctrl->vol_name : "DISK", 0);
         diritem->DIR_Attr |= DIRITEM_ATTR_VOLUME_ID;
 
-        buf->sector_no = xdisk_part->start_sector + data_sector;
         err = xfat_bpool_write_sector(to_obj(xdisk), buf, 0);
         if (err < 0) {
             return err;
@@ -658,7 +1020,8 @@ static xfat_err_t create_fsinfo(xfat_fmt_info_t * fmt_info, xdisk_part_t * xdisk
 
     // ҪȥĿ¼
     total_free = fmt_info->fat_sectors * xdisk_part->disk->sector_size / sizeof(cluster32_t) - (2 + 1);
-    err = save_cluster_free_info(xdisk_part->disk, total_free, 3, fmt_info->fsinfo_sector, fmt_info->backup_sector);
+    err = save_cluster_free_info(xdisk_part->disk, total_free, 3,
+                    xdisk_part->start_sector + fmt_info->fsinfo_sector, fmt_info->backup_sector);
     return err;
 }
 
@@ -754,6 +1117,15 @@ xfat_err_t get_next_cluster(xfat_t * xfat, u32_t curr_cluster_no, u32_t * next_c
         xfat_err_t err;
         cluster32_t* cluster32_buf;
 
+        if (xfat->fat_mirror) {
+            if (curr_cluster_no >= fat_entry_count(xfat)) {
+                return FS_ERR_PARAM;
+            }
+
+            *next_cluster = xfat->fat_mirror[curr_cluster_no].s.next;
+            return FS_ERR_OK;
+        }
+
         err = xfat_bpool_read_sector(to_obj(xfat), &buf, to_fat_sector(xfat, curr_cluster_no));
         if (err < 0) return err;
 
@@ -766,6 +1138,21 @@ xfat_err_t get_next_cluster(xfat_t * xfat, u32_t curr_cluster_no, u32_t * next_c
     return FS_ERR_OK;
 }
 
+/**
+ * FATָصı޸
+ * @param xfat xfatṹ
+ * @param cluster غ
+ */
+static void fat_mirror_set_dirty(xfat_t* xfat, u32_t cluster) {
+    u32_t sector = cluster * sizeof(cluster32_t) / xfat_get_disk(xfat)->sector_size;
+    u32_t mask = 1u << (sector % 32);
+
+    if (!(xfat->fat_dirty[sector / 32] & mask)) {
+        xfat->fat_dirty[sector / 32] |= mask;
+        xfat->fat_dirty_count++;
+    }
+}
+
 /**
  * дָصһ
  * @param xfat xfatṹ
@@ -780,6 +1167,21 @@ xfat_err_t put_next_cluster(xfat_t* xfat, u32_t curr_cluster_no, u32_t next_clus
         u32_t i;
         cluster32_t* cluster32_buf;
 
+        if (xfat->free_bitmap && (curr_cluster_no < xfat->free_bitmap_count)) {
+            free_bitmap_update(xfat, curr_cluster_no, next_cluster != CLUSTER_FREE);
+        }
+
+        // ʹþʱֻ޸ڴ棬FATͬʱͳһд
+        if (xfat->fat_mirror) {
+            if (curr_cluster_no >= fat_entry_count(xfat)) {
+                return FS_ERR_PARAM;
+            }
+
+            xfat->fat_mirror[curr_cluster_no].s.next = next_cluster;
+            fat_mirror_set_dirty(xfat, curr_cluster_no);
+            return FS_ERR_OK;
+        }
+
         err = xfat_bpool_read_sector(to_obj(xfat), &buf, to_fat_sector(xfat, curr_cluster_no));
         if (err < 0) return err;
 
@@ -812,16 +1214,27 @@ static xfat_err_t erase_cluster(xfat_t * xfat, u32_t cluster, u8_t erase_state)
     u32_t sector = cluster_fist_sector(xfat, cluster);
     xdisk_t * xdisk = xfat_get_disk(xfat);
     xfat_buf_t * buf;
+    xfat_err_t err;
+
+    // 0ʱһɣиôصãȶ
+    if (erase_state == 0) {
+        err = xfat_bpool_invalid_sectors(to_obj(xfat), sector, xfat->sec_per_cluster);
+        if (err < 0) {
+            return err;
+        }
+
+        return xdisk_write_zeroes(xdisk, sector, xfat->sec_per_cluster);
+    }
 
-    xfat_err_t err = xfat_bpool_alloc(to_obj(xfat), &buf, sector);
+    err = xfat_bpool_alloc(to_obj(xfat), &buf, sector);
     if (err < 0) {
         return err;
     }
 
-    // todo: Żһοɷ
     memset(buf->buf, erase_state, xdisk->sector_size);
-    for (i = 0; i < xfat->sec_per_cluster; i++, buf->sector_no++) {
-        xfat_err_t err = xfat_bpool_write_sector(to_obj(xfat), buf, 1);
+    for (i = 0; i < xfat->sec_per_cluster; i++) {
+        buf->sector_no = sector + i;
+        err = xfat_bpool_write_sector(to_obj(xfat), buf, 1);
         if (err < 0) {
             return err;
         }
@@ -853,10 +1266,21 @@ static xfat_err_t allocate_free_cluster(xfat_t * xfat, u32_t curr_cluster, u32_t
     while (xfat->cluster_total_free && (allocated_count < count) && (searched_count < total_clusters)) {
         u32_t next_cluster;
 
-        err = get_next_cluster(xfat, xfat->cluster_next_free, &next_cluster);
-        if (err < 0) {
-            destroy_cluster_chain(xfat, curr_cluster);
-            return err;
+        // пдλͼʱֱһдأFAT
+        if (xfat->free_bitmap) {
+            u32_t free_cluster = free_bitmap_find(xfat, xfat->cluster_next_free);
+            if (free_cluster == CLUSTER_INVALID) {
+                break;
+            }
+
+            xfat->cluster_next_free = free_cluster;
+            next_cluster = CLUSTER_FREE;
+        } else {
+            err = get_next_cluster(xfat, xfat->cluster_next_free, &next_cluster);
+            if (err < 0) {
+                destroy_cluster_chain(xfat, curr_cluster);
+                return err;
+            }
         }
 
         if (next_cluster == CLUSTER_FREE) {
@@ -868,6 +1292,11 @@ static xfat_err_t allocate_free_cluster(xfat_t * xfat, u32_t curr_cluster, u32_t
                 return err;
             }
 
+            // ôصıҪһʱд룬λͼбΪռ
+            if (xfat->free_bitmap) {
+                free_bitmap_update(xfat, free_cluster, 1);
+            }
+
             if (en_erase) {
                 err = erase_cluster(xfat, free_cluster, 0);
                 if (err < 0) {
@@ -938,6 +1367,31 @@ xfat_err_t read_cluster(xfat_t *xfat, u8_t *buffer, u32_t cluster, u32_t count)
     return FS_ERR_OK;
 }
 
+/**
+ * ֪ͨ豸ͷŵһزʹãʹӳļܻռ
+ * ΪŻʧʱӰصͷţԲش
+ * @param xfat xfatṹ
+ * @param start_cluster ʼغ
+ * @param count Ϊ0ʱ
+ */
+static void discard_clusters(xfat_t* xfat, u32_t start_cluster, u32_t count) {
+    xdisk_t* disk = xfat_get_disk(xfat);
+    u32_t start_sector, sector_count;
+
+    if ((count == 0) || !xdisk_can_discard(disk)) {
+        return;
+    }
+
+    // Щصãȶ֮дռÿռ
+    start_sector = cluster_fist_sector(xfat, start_cluster);
+    sector_count = count * xfat->sec_per_cluster;
+    if (xfat_bpool_invalid_sectors(to_obj(xfat), start_sector, sector_count) < 0) {
+        return;
+    }
+
+    xdisk_discard(disk, start_sector, sector_count);
+}
+
 /**
  * صӹϵ
  * @param xfat xfatṹ
@@ -946,35 +1400,31 @@ xfat_err_t read_cluster(xfat_t *xfat, u8_t *buffer, u32_t cluster, u32_t count)
  */
 static xfat_err_t destroy_cluster_chain(xfat_t* xfat, u32_t cluster) {
     xfat_err_t err = FS_ERR_OK;
-    u32_t i;
-    xdisk_t* disk = xfat_get_disk(xfat);
     u32_t curr_cluster = cluster;
+    u32_t discard_start = 0, discard_count = 0;
 
     while (is_cluster_valid(curr_cluster)) {
         u32_t next_cluster;
-        xfat_buf_t* buf;
-        xfat_err_t err;
-        cluster32_t* cluster32_buf;
 
-        err = xfat_bpool_read_sector(to_obj(xfat), &buf, to_fat_sector(xfat, curr_cluster));
+        err = get_next_cluster(xfat, curr_cluster, &next_cluster);
         if (err < 0) return err;
 
-        cluster32_buf = (cluster32_t*)(buf->buf + to_fat_offset(xfat, curr_cluster));
-        next_cluster = cluster32_buf->s.next;
-        cluster32_buf->s.next = CLUSTER_FREE;
-
-        err = xfat_bpool_write_sector(to_obj(xfat), buf, 1);
+        err = put_next_cluster(xfat, curr_cluster, CLUSTER_FREE);
         if (err < 0) return err;
 
-        for (i = 1; i < xfat->fat_tbl_nr; i++) {
-            buf->sector_no += xfat->fat_tbl_sectors;
-            err = xfat_bpool_write_sector(to_obj(xfat), buf, 1);
-            if (err < 0) return err;
+        // ĴغϲΪһΣĴʱ֪ͨ豸
+        if (discard_count && (curr_cluster == discard_start + discard_count)) {
+            discard_count++;
+        } else {
+            discard_clusters(xfat, discard_start, discard_count);
+            discard_start = curr_cluster;
+            discard_count = 1;
         }
 
         curr_cluster = next_cluster;
         xfat->cluster_total_free++;
     }
+    discard_clusters(xfat, discard_start, discard_count);
 
     if (!is_cluster_valid(xfat->cluster_next_free)) {
         xfat->cluster_next_free = cluster;
@@ -1480,7 +1930,7 @@ static xfat_err_t open_sub_file (xfat_t * xfat, u32_t dir_cluster, xfile_t * fil
 
     xfat_obj_init(&file->obj, XFAT_OBJ_FILE);
 
-    err = xfat_bpool_init(&file->obj, 0, 0, 0);
+    err = xfat_bpool_init(&file->obj, 0, 0, 0, 0);
     if (err < 0) {
         return err;
     }
@@ -1542,6 +1992,9 @@ static xfat_err_t open_sub_file (xfat_t * xfat, u32_t dir_cluster, xfile_t * fil
     file->xfat = xfat;
     file->pos = 0;
     file->err = FS_ERR_OK;
+    file->extent_count = 0;
+    file->extent_end = 0;
+    file->walk_index = 0;
     return FS_ERR_OK;
 }
 
@@ -1980,6 +2433,141 @@ xfat_err_t xfile_mkfile (const char * path) {
     return FS_ERR_OK;
 }
 
+/**
+ * ȡļָŵĴضӦĴغ
+ * ӳжֲңδʱӳĩβشңĴؼӳ
+ * ӳʱټ¼ֻסҵλã֮ĲҴӸλü
+ * @param file Ѵ򿪵ļ
+ * @param index ļеţ0ʼ
+ * @param cluster ӦĴغţȲʱΪCLUSTER_INVALID
+ * @return
+ */
+static xfat_err_t file_get_cluster(xfile_t * file, u32_t index, u32_t * cluster) {
+    xfile_extent_t * extent;
+    u32_t curr_index, curr_cluster;
+    u8_t record = 1;
+
+    if (index == 0) {
+        *cluster = file->start_cluster;
+        return FS_ERR_OK;
+    }
+
+    if (file->extent_count) {
+        extent = file->extent + file->extent_count - 1;
+        if (index < extent->file_cluster + extent->count) {
+            u32_t low = 0, high = file->extent_count - 1;
+
+            while (low < high) {
+                u32_t mid = (low + high + 1) / 2;
+
+                if (file->extent[mid].file_cluster <= index) {
+                    low = mid;
+                } else {
+                    high = mid - 1;
+                }
+            }
+
+            extent = file->extent + low;
+            *cluster = extent->cluster + (index - extent->file_cluster);
+            return FS_ERR_OK;
+        }
+
+        if (file->extent_end) {
+            *cluster = CLUSTER_INVALID;
+            return FS_ERR_OK;
+        }
+
+        curr_index = extent->file_cluster + extent->count - 1;
+        curr_cluster = extent->cluster + extent->count - 1;
+
+        if ((file->walk_index > curr_index) && (file->walk_index <= index)) {
+            curr_index = file->walk_index;
+            curr_cluster = file->walk_cluster;
+            record = 0;
+        }
+    } else {
+        if (!is_cluster_valid(file->start_cluster)) {
+            *cluster = CLUSTER_INVALID;
+            return FS_ERR_OK;
+        }
+
+        extent = file->extent;
+        extent->file_cluster = 0;
+        extent->cluster = file->start_cluster;
+        extent->count = 1;
+        file->extent_count = 1;
+        curr_index = 0;
+        curr_cluster = file->start_cluster;
+    }
+
+    // ĴزһΣʱΣʱֻҲ¼
+    while (curr_index < index) {
+        u32_t next_cluster;
+        xfat_err_t err;
+
+        err = get_next_cluster(file->xfat, curr_cluster, &next_cluster);
+        if (err < 0) {
+            return err;
+        }
+
+        if (!is_cluster_valid(next_cluster)) {
+            file->extent_end = record;
+            *cluster = CLUSTER_INVALID;
+            return FS_ERR_OK;
+        }
+
+        curr_index++;
+        curr_cluster = next_cluster;
+        if (!record) {
+            file->walk_index = curr_index;
+            file->walk_cluster = curr_cluster;
+            continue;
+        }
+
+        extent = file->extent + file->extent_count - 1;
+        if (next_cluster == extent->cluster + extent->count) {
+            extent->count++;
+        } else if (file->extent_count < XFILE_EXTENT_NR) {
+            extent++;
+            extent->file_cluster = curr_index;
+            extent->cluster = next_cluster;
+            extent->count = 1;
+            file->extent_count++;
+        } else {
+            file->walk_index = curr_index;
+            file->walk_cluster = curr_cluster;
+            record = 0;
+        }
+    }
+
+    *cluster = curr_cluster;
+    return FS_ERR_OK;
+}
+
+/**
+ * ضϺӳֻļǰcount
+ * @param file Ѵ򿪵ļ
+ * @param count Ĵ
+ */
+static void file_trim_extent(xfile_t * file, u32_t count) {
+    while (file->extent_count) {
+        xfile_extent_t * extent = file->extent + file->extent_count - 1;
+
+        if (extent->file_cluster < count) {
+            if (extent->file_cluster + extent->count > count) {
+                extent->count = count - extent->file_cluster;
+            }
+            break;
+        }
+        file->extent_count--;
+    }
+
+    file->extent_end = 0;
+    if (file->walk_index >= count) {
+        file->walk_index = 0;
+    }
+}
+
 static xfat_err_t move_file_pos(xfile_t* file, u32_t move_bytes) {
 	u32_t to_move = move_bytes;
 	u32_t cluster_offset;
@@ -1989,12 +2577,12 @@ static xfat_err_t move_file_pos(xfile_t* file, u32_t move_bytes) {
 		to_move = file->size - file->pos;
 	}
 
-	// ؼƶҪ
+	// ؼƶҪأһشӳлȡ
 	cluster_offset = to_cluster_offset(file->xfat, file->pos);
 	if (cluster_offset + to_move >= file->xfat->cluster_byte_size) {
-		u32_t curr_cluster = file->curr_cluster;
+		u32_t curr_cluster;
 
-		xfat_err_t err = get_next_cluster(file->xfat, curr_cluster, &curr_cluster);
+		xfat_err_t err = file_get_cluster(file, (u32_t)to_cluster(file->xfat, file->pos) + 1, &curr_cluster);
 		if (err != FS_ERR_OK) {
 			file->err = err;
 			return err;
@@ -2022,6 +2610,7 @@ xfile_size_t xfile_read(void * buffer, xfile_size_t elem_size, xfile_size_t coun
     xfile_size_t r_count_readed = 0;
     xfile_size_t bytes_to_read = count * elem_size;
     u8_t * read_buffer = (u8_t *)buffer;
+    xfat_err_t err = FS_ERR_OK, io_err;
 
     // ֱֻӶͨļ
     if (file->type != FAT_FILE) {
@@ -2041,10 +2630,11 @@ xfile_size_t xfile_read(void * buffer, xfile_size_t elem_size, xfile_size_t coun
     }
 
 
+    // 첽ύʱҲҪȵȴύĶɣܷ
     while ((bytes_to_read > 0) && is_cluster_valid(file->curr_cluster)) {
-        xfat_err_t err;
         xfile_size_t curr_read_bytes = 0;
-        u32_t sector_count = 0;
+        u32_t sector_count = 0, tail_sector;
+        xfat_buf_t * tail_buf;
 		u32_t cluster_sector = to_sector(disk, to_cluster_offset(file->xfat, file->pos));  // е
 		u32_t sector_offset = to_sector_offset(disk, file->pos);  // ƫλ
 		u32_t start_sector = cluster_fist_sector(file->xfat, file->curr_cluster) + cluster_sector;
@@ -2069,8 +2659,7 @@ xfile_size_t xfile_read(void * buffer, xfile_size_t elem_size, xfile_size_t coun
             // todo: Сʱܻ¼ͬһ
             err = xfat_bpool_read_sector(to_obj(file), &buf, start_sector);
             if (err < 0) {
-                file->err = err;
-                return 0;
+                break;
             }
 
             memcpy(read_buffer, buf->buf + sector_offset, curr_read_bytes);
@@ -2090,16 +2679,47 @@ xfile_size_t xfile_read(void * buffer, xfile_size_t elem_size, xfile_size_t coun
             // пѾڲȫд
             err = xfat_bpool_flush_sectors(to_obj(file), start_sector, sector_count);
             if (err < 0) {
-                return err;
+                break;
             }
 
-            err = xdisk_read_sector(disk, read_buffer, start_sector, sector_count);
-            if (err != FS_ERR_OK) {
-                file->err = err;
-                return 0;
+            curr_read_bytes = sector_count * disk->sector_size;
+            tail_sector = start_sector + sector_count;
+            tail_buf = (xfat_buf_t *)0;
+
+            // ĩβһڱСδʱΪ仺飬ǰͨһηɢ
+            if ((bytes_to_read > curr_read_bytes) && (cluster_sector + sector_count < file->xfat->sec_per_cluster)
+                && (xfat_bpool_find(to_obj(file), &tail_buf, tail_sector) < 0)) {
+                err = xfat_bpool_alloc(to_obj(file), &tail_buf, tail_sector);
+                if (err < 0) {
+                    break;
+                }
+            } else {
+                tail_buf = (xfat_buf_t *)0;
+            }
+
+            if (tail_buf) {
+                xdisk_vec_t vec[2];
+
+                vec[0].buffer = read_buffer;
+                vec[0].count = sector_count;
+                vec[1].buffer = tail_buf->buf;
+                vec[1].count = 1;
+                err = xdisk_read_sector_v(disk, vec, 2, start_sector);
+                if (err != FS_ERR_OK) {
+                    // еݲ
+                    xfat_bpool_invalid_sectors(to_obj(file), tail_sector, 1);
+                    break;
+                }
+
+                memcpy(read_buffer + curr_read_bytes, tail_buf->buf, bytes_to_read - curr_read_bytes);
+                curr_read_bytes = bytes_to_read;
+            } else {
+                err = xdisk_submit_read(disk, read_buffer, start_sector, sector_count);
+                if (err != FS_ERR_OK) {
+                    break;
+                }
             }
 
-            curr_read_bytes = sector_count * disk->sector_size;
             read_buffer += curr_read_bytes;
             bytes_to_read -= curr_read_bytes;
         }
@@ -2107,9 +2727,18 @@ xfile_size_t xfile_read(void * buffer, xfile_size_t elem_size, xfile_size_t coun
         r_count_readed += curr_read_bytes;
 
 		err = move_file_pos(file, curr_read_bytes);
-		if (err) return 0;
+		if (err) break;
 	}
 
+    io_err = xdisk_wait_io(disk);
+    if (err == FS_ERR_OK) {
+        err = io_err;
+    }
+    if (err != FS_ERR_OK) {
+        file->err = err;
+        return 0;
+    }
+
     file->err = file->size == file->pos;
     return r_count_readed / elem_size;
 }
@@ -2179,8 +2808,19 @@ static xfat_err_t expand_file(xfile_t * file, xfile_size_t size) {
 		u32_t curr_culster = file->curr_cluster;
 
         // ȶλļһ, ҪλļСΪ0Ĵ
+        // ӳֱҵļĩβڵĴأܻдأشҵĩβ
         if (file->size > 0) {
-			u32_t next_cluster = file->curr_cluster;
+			u32_t next_cluster;
+
+			err = file_get_cluster(file, (file->size - 1) / xfat->cluster_byte_size, &next_cluster);
+			if (err < 0) {
+				file->err = err;
+				return err;
+			}
+
+			if (!is_cluster_valid(next_cluster)) {
+				next_cluster = file->curr_cluster;
+			}
 
 			do {
 				curr_culster = next_cluster;
@@ -2200,6 +2840,9 @@ static xfat_err_t expand_file(xfile_t * file, xfile_size_t size) {
             return err;
         }
 
+        // ·Ĵ֮ʱټӳ
+        file->extent_end = 0;
+
 		if (!is_cluster_valid(file->start_cluster)) {
 			file->start_cluster = start_free_cluster;
 			file->curr_cluster = start_free_cluster;
@@ -2225,7 +2868,7 @@ xfile_size_t xfile_write(void * buffer, xfile_size_t elem_size, xfile_size_t cou
     xdisk_t * disk = file_get_disk(file);
     u32_t r_count_write = 0;
     xfile_size_t bytes_to_write = count * elem_size;
-    xfat_err_t err;
+    xfat_err_t err = FS_ERR_OK, io_err;
     u8_t * write_buffer = (u8_t *)buffer;
 
      // ֱֻдͨļ
@@ -2256,9 +2899,10 @@ xfile_size_t xfile_write(void * buffer, xfile_size_t elem_size, xfile_size_t cou
         }
     }
 
+    // д첽ύʱҲҪȵȴύдɣܷ
 	while ((bytes_to_write > 0) && is_cluster_valid(file->curr_cluster)) {
 		u32_t curr_write_bytes = 0;
-        u32_t sector_count = 0;
+        u32_t sector_count = 0, tail_sector;
 
 		u32_t cluster_sector = to_sector(disk, to_cluster_offset(file->xfat, file->pos));  // еƫ
 		u32_t sector_offset = to_sector_offset(disk, file->pos);  // ƫλ
@@ -2284,15 +2928,13 @@ xfile_size_t xfile_write(void * buffer, xfile_size_t elem_size, xfile_size_t cou
             // todo: Сʱܻ¼ͬһ
             err = xfat_bpool_read_sector(to_obj(file), &buf, start_sector);
             if (err < 0) {
-                file->err = err;
-                return 0;
+                break;
             }
 
             memcpy(buf->buf + sector_offset, write_buffer, curr_write_bytes);
             err = xfat_bpool_write_sector(to_obj(file), buf, 0);
             if (err < 0) {
-                file->err = err;
-                return 0;
+                break;
             }
 
             write_buffer += curr_write_bytes;
@@ -2310,16 +2952,47 @@ xfile_size_t xfile_write(void * buffer, xfile_size_t elem_size, xfile_size_t cou
             // ѾУֱӶµ.ҲԿwrite_bufferид
             err = xfat_bpool_invalid_sectors(to_obj(file), start_sector, sector_count);
             if (err < 0) {
-                return err;
+                break;
             }
 
-            err = xdisk_write_sector(disk, write_buffer, start_sector, sector_count);
-            if (err != FS_ERR_OK) {
-                file->err = err;
-                return 0;
+            curr_write_bytes = sector_count * disk->sector_size;
+            tail_sector = start_sector + sector_count;
+
+            // ĩβһڱʱڻкϲǰͨһξۼд
+            if ((bytes_to_write > curr_write_bytes) && (cluster_sector + sector_count < file->xfat->sec_per_cluster)) {
+                xfat_buf_t * tail_buf;
+                xdisk_vec_t vec[2];
+
+                err = xfat_bpool_read_sector(to_obj(file), &tail_buf, tail_sector);
+                if (err < 0) {
+                    break;
+                }
+
+                // ȱΪ࣬дʧʱڻдʱ
+                memcpy(tail_buf->buf, write_buffer + curr_write_bytes, bytes_to_write - curr_write_bytes);
+                err = xfat_bpool_write_sector(to_obj(file), tail_buf, 0);
+                if (err < 0) {
+                    break;
+                }
+
+                vec[0].buffer = write_buffer;
+                vec[0].count = sector_count;
+                vec[1].buffer = tail_buf->buf;
+                vec[1].count = 1;
+                err = xdisk_write_sector_v(disk, vec, 2, start_sector);
+                if (err != FS_ERR_OK) {
+                    break;
+                }
+
+                xfat_buf_set_state(tail_buf, XFAT_BUF_STATE_CLEAN);
+                curr_write_bytes = bytes_to_write;
+            } else {
+                err = xdisk_submit_write(disk, write_buffer, start_sector, sector_count);
+                if (err != FS_ERR_OK) {
+                    break;
+                }
             }
 
-            curr_write_bytes = sector_count * disk->sector_size;
             write_buffer += curr_write_bytes;
             bytes_to_write -= curr_write_bytes;
         }
@@ -2327,7 +3000,16 @@ xfile_size_t xfile_write(void * buffer, xfile_size_t elem_size, xfile_size_t cou
         r_count_write += curr_write_bytes;
 
 		err = move_file_pos(file, curr_write_bytes);
-		if (err) return 0;
+		if (err) break;
+    }
+
+    io_err = xdisk_wait_io(disk);
+    if (err == FS_ERR_OK) {
+        err = io_err;
+    }
+    if (err != FS_ERR_OK) {
+        file->err = err;
+        return 0;
     }
 
     file->err = file->pos == file->size;
@@ -2362,8 +3044,7 @@ xfile_size_t xfile_tell(xfile_t * file) {
 xfat_err_t xfile_seek(xfile_t * file, xfile_ssize_t offset, xfile_orgin_t origin) {
     xfat_err_t err = FS_ERR_OK;
     xfile_ssize_t final_pos;
-    xfile_size_t offset_to_move;
-    u32_t curr_cluster, curr_pos;
+    u32_t curr_cluster;
 
     // ȡյĶλλ
     switch (origin) {
@@ -2386,42 +3067,14 @@ xfat_err_t xfile_seek(xfile_t * file, xfile_ssize_t offset, xfile_orgin_t origin
         return FS_ERR_PARAM;
     }
 
-    // ڵǰҪƫ
-    offset = final_pos - file->pos;
-    if (offset > 0) {
-        curr_cluster = file->curr_cluster;
-        curr_pos = file->pos;
-        offset_to_move = (xfile_size_t)offset;
-    } else {
-        curr_cluster = file->start_cluster;
-        curr_pos = 0;
-        offset_to_move = (xfile_size_t)final_pos;
-    }
-
-    while (offset_to_move > 0) {
-        u32_t cluster_offset = to_cluster_offset(file->xfat, curr_pos);
-        xfile_size_t curr_move = offset_to_move;
-
-        // ǰ
-        if (cluster_offset + curr_move < file->xfat->cluster_byte_size) {
-            curr_pos += curr_move;
-            break;
-        }
-
-        // ǰأֻڵǰƶ
-        curr_move = file->xfat->cluster_byte_size - cluster_offset;
-        curr_pos += curr_move;
-        offset_to_move -= curr_move;
-
-        // һ: ǷҪжϺǷȷ
-        err = get_next_cluster(file->xfat, curr_cluster, &curr_cluster);
-        if (err < 0) {
-            file->err = err;
-            return err;
-        }
+    // ӳֱӶλĿλڵĴأز
+    err = file_get_cluster(file, (u32_t)to_cluster(file->xfat, final_pos), &curr_cluster);
+    if (err < 0) {
+        file->err = err;
+        return err;
     }
 
-    file->pos = curr_pos;
+    file->pos = (xfile_size_t)final_pos;
     file->curr_cluster = curr_cluster;
     return FS_ERR_OK;
 }
@@ -2435,19 +3088,13 @@ xfat_err_t xfile_seek(xfile_t * file, xfile_ssize_t offset, xfile_orgin_t origin
  */
 static xfat_err_t truncate_file(xfile_t * file, xfile_size_t size) {
     xfat_err_t err;
-    u32_t pos = 0;
-    u32_t curr_cluster = file->start_cluster;
+    u32_t keep_count = (u32_t)(((u64_t)size + file->xfat->cluster_byte_size - 1) / file->xfat->cluster_byte_size);
+    u32_t curr_cluster;
 
     // λsizeӦcluster
-    while (pos < size) {
-        u32_t next_cluster;
-
-        err = get_next_cluster(file->xfat, curr_cluster, &next_cluster);
-        if (err < 0) {
-            return err;
-        }
-        pos += file->xfat->cluster_byte_size;
-        curr_cluster = next_cluster;
+    err = file_get_cluster(file, keep_count, &curr_cluster);
+    if (err < 0) {
+        return err;
     }
 
     // ٺ̵FAT
@@ -2455,6 +3102,7 @@ static xfat_err_t truncate_file(xfile_t * file, xfile_size_t size) {
     if (err < 0) {
         return err;
     }
+    file_trim_extent(file, keep_count);
 
     if (size == 0) {
         file->start_cluster = 0;
@@ -2957,19 +3605,28 @@ static xfat_err_t rmdir_all_children(xfat_t* xfat, u32_t parent_cluster) {
 
         if (is_locate_type_match(diritem, XFILE_LOCATE_NORMAL)) {
             u32_t dir_cluster = get_diritem_cluster(diritem);
-            u32_t dir_sector = to_phy_sector(xfat, found_cluster, found_offset);
+            u8_t is_dir = get_file_type(diritem) == FAT_DIR;
+            xfat_err_t pin_err;
 
             diritem->DIR_Name[0] = DIRITEM_NAME_FREE;
             err = xfat_bpool_write_sector(to_obj(xfat), buf, 0);
             if (err < 0) return err;
 
-            if (get_file_type(diritem) == FAT_DIR) {
-                // ܻĻ棬ʹdir_cluster
+            // ̶סǰĿ¼ɾʱ¶ȡ
+            // 治ʱ̶ʧܣʱbufܱ滻Ժֻʹȡdir_cluster
+            pin_err = xfat_bpool_get_buf(to_obj(xfat), buf);
+
+            if (is_dir) {
                 err = rmdir_all_children(xfat, dir_cluster);
-                if (err < 0) return err;
             }
 
-            err = destroy_cluster_chain(xfat, dir_cluster);
+            if (err >= 0) {
+                err = destroy_cluster_chain(xfat, dir_cluster);
+            }
+
+            if (pin_err == FS_ERR_OK) {
+                xfat_bpool_put_buf(to_obj(xfat), buf);
+            }
             if (err < 0) return err;
         }
 
@@ -3068,24 +3725,35 @@ xfat_err_t xfile_close(xfile_t *file) {
     xfat_err_t err;
 
     err = xfat_bpool_flush(to_obj(file));
+    if (err < 0) {
+        return err;
+    }
+
+    // ļĻɵṩرպ󼴲
+    err = xfat_bpool_release(to_obj(file));
     return err;
 }
 
 xfat_err_t xfile_set_buf(xfile_t* file, u8_t* buf, u32_t size) {
     xfat_err_t err;
 	xfat_t* xfat = file->xfat;
-	xdisk_part_t* part = xfat->disk_part;
-
-	err = xfat_bpool_flush_sectors(to_obj(xfat), part->start_sector, part->total_sector);
-	if (err < 0) {
-		return err;
-	}
 
-	err = xfat_bpool_invalid_sectors(to_obj(xfat), part->start_sector, part->total_sector);
-	if (err < 0) {
-		return err;
-	}
+    // ϵĸعظ棬ֻͷԭеĻ
+    err = xfat_bpool_release(to_obj(file));
+    if (err < 0) {
+        return err;
+    }
 
-    err = xfat_bpool_init(to_obj(file), xfat_get_disk(xfat)->sector_size, buf, size);
+    err = xfat_bpool_init(to_obj(file), xfat_get_disk(xfat)->sector_size, buf, size, xfat_get_disk(xfat)->buf_align);
     return err;
 }
+
+/**
+ * ļ滻ԣxfile_set_buf֮
+ * @param file
+ * @param policy
+ * @return
+ */
+xfat_err_t xfile_set_buf_policy(xfile_t* file, xfat_buf_policy_t policy) {
+    return xfat_bpool_set_policy(to_obj(file), policy);
+}
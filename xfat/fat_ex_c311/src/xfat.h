@@ -150,6 +150,15 @@ typedef struct _fsinto_t {
 
 #define XFAT_NAME_LEN       16
 
+// FATĿռСFAT + ¼޸ĵλͼ
+#define XFAT_FAT_MIRROR_SIZE(fat_sectors, sector_size)  \
+    ((fat_sectors) * (sector_size) + ((fat_sectors) + 31) / 32 * sizeof(u32_t))
+
+// дλͼĿռСFATı㣬ÿһλ + λͼÿһλժҪ
+#define XFAT_FREE_BITMAP_WORDS(fat_sectors, sector_size)    (((fat_sectors) * ((sector_size) / 4) + 31) / 32)
+#define XFAT_FREE_BITMAP_SIZE(fat_sectors, sector_size)  \
+    ((XFAT_FREE_BITMAP_WORDS(fat_sectors, sector_size) + (XFAT_FREE_BITMAP_WORDS(fat_sectors, sector_size) + 31) / 32) * sizeof(u32_t))
+
 /**
  * xfatṹ
  */
@@ -174,6 +183,14 @@ typedef struct _xfat_t {
 
     xfat_bpool_t bpool;                 // FAT棺ڷļݵķ
 
+    cluster32_t * fat_mirror;           // FATڴеľΪ0ʱFAT
+    u32_t * fat_dirty;                  // ޸ġδдFATλͼ
+    u32_t fat_dirty_count;              // ޸ġδдFAT
+
+    u32_t * free_bitmap;                // дλͼÿһλ1ʾռãΪ0ʱFAT
+    u32_t * free_summary;               // λͼժҪλͼÿֶӦһλ1ʾеĴȫռ
+    u32_t free_bitmap_count;            // λͼǵĴغ+1
+
     struct _xfat_t* next;
 
 } xfat_t;
@@ -225,6 +242,17 @@ typedef struct _xfileinfo_t {
     xfile_time_t modify_time;                       // ޸ʱ
 } xfileinfo_t;
 
+#define XFILE_EXTENT_NR             32              // ÿ򿪵ļɼ¼Ĵ
+
+/**
+ * һĴ
+ */
+typedef struct _xfile_extent_t {
+    u32_t file_cluster;             // εһļеĴ
+    u32_t cluster;                  // εʼغ
+    u32_t count;                    // Ĵ
+}xfile_extent_t;
+
 /**
  * ļ
  */
@@ -244,6 +272,12 @@ typedef struct _xfile_t {
     u32_t dir_cluster;              // ڵĸĿ¼ʼغ
     u32_t dir_cluster_offset;       // ڵĸĿ¼Ĵƫ
 
+    xfile_extent_t extent[XFILE_EXTENT_NR];     // ӳ䣬ļͷ¼ʱ𲽽
+    u32_t extent_count;             // Ѽ¼
+    u8_t extent_end;                // ӳǷѵĩβ
+    u32_t walk_index;               // ӳһشҵĴţΪ0ʾ
+    u32_t walk_cluster;             // ŶӦĴغ
+
     xfat_bpool_t bpool;             // ļݻ
 } xfile_t;
 
@@ -309,6 +343,10 @@ xfat_err_t xfat_init(void);
 xfat_err_t xfat_mount(xfat_t * xfat, xdisk_part_t * xdisk_part, const char * mount_name);
 void xfat_unmount(xfat_t * xfat);
 xfat_err_t xfat_set_buf(xfat_t * xfat, u8_t * buf, u32_t size);
+xfat_err_t xfat_set_buf_policy(xfat_t * xfat, xfat_buf_policy_t policy);
+xfat_err_t xfat_set_fat_mirror(xfat_t * xfat, u8_t * buf, u32_t size);
+xfat_err_t xfat_set_free_bitmap(xfat_t * xfat, u8_t * buf, u32_t size);
+xfat_err_t xfat_sync(xfat_t * xfat);
 
 xfat_err_t xfat_fmt_ctrl_init(xfat_fmt_ctrl_t * ctrl);
 xfat_err_t xfat_format (xdisk_part_t * xdisk_part, xfat_fmt_ctrl_t * ctrl);
@@ -342,5 +380,6 @@ xfat_err_t xfile_set_mtime (const char * path, xfile_time_t * time);
 xfat_err_t xfile_set_ctime (const char * path, xfile_time_t * time);
 
 xfat_err_t xfile_set_buf(xfile_t * file, u8_t * buf, u32_t size);
+xfat_err_t xfile_set_buf_policy(xfile_t * file, xfat_buf_policy_t policy);
 
 #endif /* XFAT_H */
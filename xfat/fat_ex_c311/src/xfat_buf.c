@@ -4,89 +4,496 @@
  * γַhttp://01ketang.cc
  * ȨԴǿԴοǰϵߡ
  */
+#include <string.h>
 #include "xfat_buf.h"
 #include "xdisk.h"
 #include "xfat.h"
 
+#define BPOOL_VEC_MAX       (XFAT_BUF_FLUSH_SIZE / 512)    // ϲдʱСС
+
+// дԭͳ
+#define BPOOL_WRITE_FLUSH           0       // д
+#define BPOOL_WRITE_FORCE           1       // ǿƻдָ
+#define BPOOL_WRITE_TICK            2       // ʱд
+
 /**
  * ȡbuf״̬
+ * ͬʱάڻص¿ʱ
  * @param buf
  * @param state
  */
 void xfat_buf_set_state(xfat_buf_t * buf, u32_t state) {
+    xfat_bpool_t* pool = buf->pool;
+    u32_t old_state = xfat_buf_state(buf);
+
+    if ((old_state != XFAT_BUF_STATE_DIRTY) && (state == XFAT_BUF_STATE_DIRTY)) {
+        pool->dirty_count++;
+        buf->dirty_tick = pool->disk->bpool_tick;
+    } else if ((old_state == XFAT_BUF_STATE_DIRTY) && (state != XFAT_BUF_STATE_DIRTY)) {
+        pool->dirty_count--;
+    }
+
     buf->flags &= ~XFAT_BUF_STATE_MSK;
     buf->flags |= state;
 }
 
-static xfat_err_t bpool_moveto_first(xfat_bpool_t* pool, xfat_buf_t* buf) {
-    xfat_err_t err = FS_ERR_OK;
+/**
+ * ӻȡ£ָĸָ
+ * @param pool
+ * @param buf
+ */
+static void bpool_unlink(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (buf->next == buf) {
+        pool->first = pool->last = (xfat_buf_t*)0;
+        pool->hand = pool->a1_first = (xfat_buf_t*)0;
+        return;
+    }
 
+    // öڱβȡµǱβʱоʹ˱
+    if (pool->a1_first == buf) {
+        pool->a1_first = (pool->last == buf) ? (xfat_buf_t*)0 : buf->next;
+    }
+    if (pool->hand == buf) {
+        pool->hand = buf->next;
+    }
     if (pool->first == buf) {
-        return err;
+        pool->first = buf->next;
+    }
+    if (pool->last == buf) {
+        pool->last = buf->pre;
     }
 
     buf->pre->next = buf->next;
     buf->next->pre = buf->pre;
-    if (pool->last == buf) {
-        pool->last = buf->pre;
+}
+
+/**
+ * 뵽pos֮ǰposΪ0ʱ뵽lastfirst֮
+ * @param pool
+ * @param buf
+ * @param pos
+ */
+static void bpool_link_before(xfat_bpool_t* pool, xfat_buf_t* buf, xfat_buf_t* pos) {
+    if (pool->first == (xfat_buf_t*)0) {
+        buf->pre = buf->next = buf;
+        pool->first = pool->last = buf;
+        return;
+    }
+
+    if (pos == (xfat_buf_t*)0) {
+        pos = pool->first;
+    }
+    buf->next = pos;
+    buf->pre = pos->pre;
+    pos->pre->next = buf;
+    pos->pre = buf;
+}
+
+/**
+ * ͷ
+ * @param pool
+ * @param buf
+ */
+static void bpool_moveto_first(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (pool->first == buf) {
+        return;
     }
 
-    pool->last->next = buf;
-    pool->first->pre = buf;
-    buf->next = pool->first;
-    buf->pre = pool->first->pre;
+    bpool_unlink(pool, buf);
+    bpool_link_before(pool, buf, (xfat_buf_t*)0);
     pool->first = buf;
+}
 
-    return err;
+/**
+ * βʹȱ
+ * @param pool
+ * @param buf
+ */
+static void bpool_moveto_last(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (pool->last == buf) {
+        return;
+    }
+
+    bpool_unlink(pool, buf);
+    bpool_link_before(pool, buf, (xfat_buf_t*)0);
+    pool->last = buf;
 }
 
+/**
+ * ڹϣвָĻ
+ * ߸sector_noδдĿ飬ŶӦ
+ * @param pool
+ * @param sector_no
+ * @return δҵ0
+ */
+static xfat_buf_t* bpool_hash_find(xfat_bpool_t* pool, u32_t sector_no) {
+    xfat_buf_t* buf = pool->hash_tbl[sector_no & pool->hash_mask];
+
+    while (buf != (xfat_buf_t*)0) {
+        if ((buf->hash_no == sector_no) && (buf->sector_no == sector_no)) {
+            return buf;
+        }
+        buf = buf->hash_next;
+    }
+    return (xfat_buf_t*)0;
+}
 
 /**
- * ӻбзһ
+ * ӹϣƳ
+ * @param pool
+ * @param buf
+ */
+static void bpool_hash_remove(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    xfat_buf_t** pp = &pool->hash_tbl[buf->hash_no & pool->hash_mask];
+
+    while (*pp != (xfat_buf_t*)0) {
+        if (*pp == buf) {
+            *pp = buf->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    buf->hash_next = (xfat_buf_t*)0;
+}
+
+/**
+ * buf->sector_noΪϣ
  * @param pool
+ * @param buf
+ */
+static void bpool_hash_insert(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    xfat_buf_t** head = &pool->hash_tbl[buf->sector_no & pool->hash_mask];
+
+    buf->hash_no = buf->sector_no;
+    buf->hash_next = *head;
+    *head = buf;
+}
+
+/**
+ * ڴϵлвָĻ
+ * @param pool ߵĻأȲ
  * @param sector_no
- * @return
+ * @return δҵ0
  */
-static xfat_err_t bpool_find_buf(xfat_bpool_t* pool, u32_t sector_no, xfat_buf_t** buf) {
-    xfat_buf_t* r_buf;
+static xfat_buf_t* bpool_disk_find(xfat_bpool_t* pool, u32_t sector_no) {
+    xfat_bpool_t* curr_pool;
+    xfat_buf_t* buf;
+
+    if (pool->size > 0) {
+        buf = bpool_hash_find(pool, sector_no);
+        if (buf != (xfat_buf_t*)0) {
+            return buf;
+        }
+    }
+
+    if (pool->disk == (struct _xdisk_t*)0) {
+        return (xfat_buf_t*)0;
+    }
+
+    for (curr_pool = &pool->disk->bpool; curr_pool != (xfat_bpool_t*)0; curr_pool = curr_pool->next) {
+        if ((curr_pool == pool) || (curr_pool->size == 0)) {
+            continue;
+        }
+
+        buf = bpool_hash_find(curr_pool, sector_no);
+        if (buf != (xfat_buf_t*)0) {
+            return buf;
+        }
+    }
+    return (xfat_buf_t*)0;
+}
+
+/**
+ * ָ鿪ʼͷң̶Ŀ
+ * @param pool
+ * @param buf
+ * @return п鶼̶ʱ0
+ */
+static xfat_buf_t* bpool_skip_pinned(xfat_bpool_t* pool, xfat_buf_t* buf) {
     u32_t size = pool->size;
-	xfat_buf_t* free_buf = (xfat_buf_t *)0;
-    xfat_err_t err;
 
-    if (pool->first == (xfat_buf_t*)0) {
-        return FS_ERR_NO_BUFFER;
+    while (size--) {
+        if (buf->ref == 0) {
+            return buf;
+        }
+        buf = buf->pre;
+    }
+    return (xfat_buf_t*)0;
+}
+
+/**
+ * LRUԣлװĿͷ滻βĿ
+ */
+static void bpool_lru_touch(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    bpool_moveto_first(pool, buf);
+}
+
+static xfat_buf_t* bpool_lru_victim(xfat_bpool_t* pool) {
+    return bpool_skip_pinned(pool, pool->last);
+}
+
+static void bpool_lru_free(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    buf->flags &= ~XFAT_BUF_REF;
+    bpool_moveto_last(pool, buf);
+}
+
+static const xfat_bpool_ops_t bpool_lru_ops = {
+    bpool_lru_touch,
+    bpool_lru_victim,
+    bpool_lru_touch,
+    bpool_lru_free,
+};
+
+/**
+ * CLOCKԣʱֻ÷λ
+ * 滻ʱʱָɨ裬;ķλֱδʹĿ
+ */
+static void bpool_clock_hit(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    buf->flags |= XFAT_BUF_REF;
+}
+
+static xfat_buf_t* bpool_clock_victim(xfat_bpool_t* pool) {
+    xfat_buf_t* buf;
+    u32_t count;
+
+    if ((xfat_buf_state(pool->last) == XFAT_BUF_STATE_FREE) && (pool->last->ref == 0)) {
+        return pool->last;
+    }
+
+    if (pool->hand == (xfat_buf_t*)0) {
+        pool->hand = pool->first;
+    }
+
+    // ɨȦҵ̶Ŀֱ
+    for (count = pool->size * 2; count > 0; count--) {
+        buf = pool->hand;
+        pool->hand = buf->next;
+
+        if (buf->ref > 0) {
+            continue;
+        }
+
+        if ((xfat_buf_state(buf) == XFAT_BUF_STATE_FREE) || !(buf->flags & XFAT_BUF_REF)) {
+            return buf;
+        }
+        buf->flags &= ~XFAT_BUF_REF;
+    }
+    return (xfat_buf_t*)0;
+}
+
+static void bpool_clock_load(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    buf->flags &= ~XFAT_BUF_REF;
+}
+
+static const xfat_bpool_ops_t bpool_clock_ops = {
+    bpool_clock_hit,
+    bpool_clock_victim,
+    bpool_clock_load,
+    bpool_lru_free,
+};
+
+/**
+ * 2QԣǰΪ(LRU)Ϊö(FIFO)
+ * װĿöУٴвŽУ
+ * ļ˳дֻöתеFATĿ¼ȵ
+ */
+static void bpool_2q_hit(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (buf->flags & XFAT_BUF_A1) {
+        buf->flags &= ~XFAT_BUF_A1;
+        pool->a1_count--;
+
+        // Ϊʱÿڱͷֱӻ
+        if (pool->first == buf) {
+            pool->a1_first = (pool->last == buf) ? (xfat_buf_t*)0 : buf->next;
+            return;
+        }
+    }
+
+    bpool_moveto_first(pool, buf);
+}
+
+static xfat_buf_t* bpool_2q_victim(xfat_bpool_t* pool) {
+    // ñβĿп飬öг޻Ϊʱ滻öĿ
+    if ((xfat_buf_state(pool->last) == XFAT_BUF_STATE_FREE)
+        || (pool->a1_count > pool->a1_limit) || (pool->a1_first == pool->first)) {
+        return bpool_skip_pinned(pool, pool->last);
+    }
+
+    // 滻δʹõĿ
+    return bpool_skip_pinned(pool, (pool->a1_first != (xfat_buf_t*)0) ? pool->a1_first->pre : pool->last);
+}
+
+static void bpool_2q_load(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (pool->a1_first == buf) {
+        return;
+    }
+
+    if (!(buf->flags & XFAT_BUF_A1)) {
+        buf->flags |= XFAT_BUF_A1;
+        pool->a1_count++;
+    }
+
+    // 뵽öеͷ
+    bpool_unlink(pool, buf);
+    if (pool->a1_first != (xfat_buf_t*)0) {
+        bpool_link_before(pool, buf, pool->a1_first);
+        if (pool->first == pool->a1_first) {
+            pool->first = buf;
+        }
+    } else {
+        bpool_link_before(pool, buf, (xfat_buf_t*)0);
+        pool->last = buf;
+    }
+    pool->a1_first = buf;
+}
+
+static void bpool_2q_free(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    // пڱβö
+    bpool_moveto_last(pool, buf);
+    if (!(buf->flags & XFAT_BUF_A1)) {
+        buf->flags |= XFAT_BUF_A1;
+        pool->a1_count++;
+        if (pool->a1_first == (xfat_buf_t*)0) {
+            pool->a1_first = buf;
+        }
     }
+}
+
+static const xfat_bpool_ops_t bpool_2q_ops = {
+    bpool_2q_hit,
+    bpool_2q_victim,
+    bpool_2q_load,
+    bpool_2q_free,
+};
+
+/**
+ * ǰøĲϢ
+ * @param pool
+ */
+static void bpool_reset_policy(xfat_bpool_t* pool) {
+    xfat_buf_t* buf = pool->first;
+    u32_t size = pool->size;
+    u8_t is_2q = (pool->policy == XFAT_BUF_POLICY_2Q);
 
-    // ӱͷʼңҵͬĿ飬ҵп
-    // ϶ûУҵδʹõĿ飬ʱ϶Ƕһ
-    r_buf = pool->first;
+    // 2Q£еĿȫȹö
+    pool->hand = pool->first;
+    pool->a1_first = is_2q ? pool->first : (xfat_buf_t*)0;
+    pool->a1_count = is_2q ? pool->size : 0;
+    pool->a1_limit = (pool->size >= 4) ? pool->size / 4 : 1;
     while (size--) {
-        switch (xfat_buf_state(r_buf)) {
-        case XFAT_BUF_STATE_FREE:
-            free_buf = r_buf;
-            break;
-        case XFAT_BUF_STATE_CLEAN:
-        case XFAT_BUF_STATE_DIRTY:
-            if (r_buf->sector_no == sector_no) {
-                *buf = r_buf;
-                err = bpool_moveto_first(pool, r_buf);
-                return err;
-            }
-            break;
+        buf->flags &= ~(XFAT_BUF_REF | XFAT_BUF_A1);
+        if (is_2q) {
+            buf->flags |= XFAT_BUF_A1;
         }
+        buf = buf->next;
+    }
+}
+/**
+ * ӳãָʹĴ洢
+ * @param buf
+ * @param keep Ƿӳеݿ洢
+ */
+static void bpool_unmap_buf(xfat_buf_t* buf, int keep) {
+    if (!(buf->flags & XFAT_BUF_MAPPED)) {
+        return;
+    }
+
+    if (keep) {
+        memcpy(buf->data, buf->buf, buf->pool->disk->sector_size);
+    }
+
+    xdisk_unmap_sector(buf->pool->disk, buf->buf, buf->hash_no, 1);
+    buf->buf = buf->data;
+    buf->flags &= ~XFAT_BUF_MAPPED;
+}
 
-        r_buf = r_buf->next;
+/**
+ * ͷŻ飺ƳϣΪвβ
+ * пڱβԱβһɸõĿ
+ * ̶Ŀͬᱻͷţڽ̶ǰᱻ
+ * @param pool
+ * @param buf
+ */
+static void bpool_free_buf(xfat_bpool_t* pool, xfat_buf_t* buf) {
+    if (xfat_buf_state(buf) != XFAT_BUF_STATE_FREE) {
+        bpool_hash_remove(pool, buf);
+        xfat_buf_set_state(buf, XFAT_BUF_STATE_FREE);
     }
+    bpool_unmap_buf(buf, 0);
+    buf->flags &= ~XFAT_BUF_RA;
+    pool->ops->free(pool, buf);
+}
+
+/**
+ * ָ¹ϣ
+ * 黺ͬһѹʱֱӶ
+ * ߿޸ӳݺдԽӳʱ
+ * @param pool Ļ
+ * @param buf
+ * @param sector_no
+ */
+static void bpool_rehash_buf(xfat_bpool_t* pool, xfat_buf_t* buf, u32_t sector_no) {
+    xfat_buf_t* old_buf;
+
+    bpool_unmap_buf(buf, 1);
+    if (xfat_buf_state(buf) != XFAT_BUF_STATE_FREE) {
+        bpool_hash_remove(pool, buf);
 
-    if (free_buf != (xfat_buf_t*)0) {
-        *buf = free_buf;
+        // Ԥδʾͱ滻˵Ԥ࣬С
+        if (buf->flags & XFAT_BUF_RA) {
+            pool->stat.ra.wasted_count++;
+            pool->ra_window >>= 1;
+        }
     }
-    else {
-        *buf = pool->last;
+    buf->flags &= ~XFAT_BUF_RA;
+
+    old_buf = bpool_disk_find(pool, sector_no);
+    if ((old_buf != (xfat_buf_t*)0) && (old_buf != buf)) {
+        bpool_free_buf(old_buf->pool, old_buf);
     }
 
-    err = bpool_moveto_first(pool, *buf);
-    return err;
+    buf->sector_no = sector_no;
+    bpool_hash_insert(pool, buf);
+}
+
+/**
+ * ӻбзһ
+ * ڴ̵һʱضӦĿ飬߻ص滻ѡп滻Ŀ
+ * @param pool ߵĻ
+ * @param sector_no
+ * @return
+ */
+static xfat_err_t bpool_find_buf(xfat_bpool_t* pool, u32_t sector_no, xfat_buf_t** buf) {
+    xfat_buf_t* r_buf;
+
+    r_buf = bpool_disk_find(pool, sector_no);
+    if (r_buf != (xfat_buf_t*)0) {
+        xfat_bpool_t* owner = r_buf->pool;
+
+        pool->stat.hit_count++;
+        if (r_buf->flags & XFAT_BUF_RA) {
+            r_buf->flags &= ~XFAT_BUF_RA;
+            owner->stat.ra.used_count++;
+        }
+        owner->ops->hit(owner, r_buf);
+    } else {
+        if (pool->first == (xfat_buf_t*)0) {
+            return FS_ERR_NO_BUFFER;
+        }
+
+        r_buf = pool->ops->victim(pool);
+        if (r_buf == (xfat_buf_t*)0) {
+            return FS_ERR_NO_BUFFER;
+        }
+
+        pool->stat.miss_count++;
+        if (xfat_buf_state(r_buf) != XFAT_BUF_STATE_FREE) {
+            pool->stat.evict_count++;
+        }
+    }
+
+    *buf = r_buf;
+    return FS_ERR_OK;
 }
 
 /**
@@ -146,38 +553,85 @@ static xdisk_t * get_obj_disk(xfat_obj_t* obj) {
 
 /**
  * ʼ̻
+ * align0ʱʼַalign룬ÿռõĿռȡalign
+ * O_DIRECTȶԻַҪռXFAT_BUF_SIZE_ALIGN
  * @param pool
  * @param disk
  * @param buffer
  * @param buf_size
+ * @param align ĶֽΪ2ݣ0ʾ
  * @return
  */
-xfat_err_t xfat_bpool_init(xfat_obj_t* obj, u32_t sector_size, u8_t* buffer, u32_t buf_size) {
-    u32_t buf_count = buf_size / (sizeof(xfat_buf_t) + sector_size);
+xfat_err_t xfat_bpool_init(xfat_obj_t* obj, u32_t sector_size, u8_t* buffer, u32_t buf_size, u32_t align) {
+    u32_t stride = XFAT_BUF_STRIDE(sector_size, align);
+    u32_t pad = align ? align - 1 : 0;
+    u32_t buf_count = (buf_size > pad) ? (buf_size - pad) / (sizeof(xfat_buf_t) + sizeof(xfat_buf_t *) + stride) : 0;
     u32_t i;
     xfat_buf_t * buf_start = (xfat_buf_t *)buffer;
-    u8_t * sector_buf_start = buffer + buf_count * sizeof(xfat_buf_t);      // ¶봦
+    xfat_buf_t ** hash_tbl = (xfat_buf_t **)(buffer + buf_count * sizeof(xfat_buf_t));
+    u8_t * sector_buf_start = (u8_t *)(hash_tbl + buf_count);
+    u32_t hash_size;
     xfat_buf_t* buf;
 
+    if (align & (align - 1)) {
+        return FS_ERR_PARAM;
+    }
+
+    // ʼַ϶
+    if (align) {
+        sector_buf_start += (align - (u32_t)((size_t)sector_buf_start & (align - 1))) & (align - 1);
+    }
+
     xfat_bpool_t* pool = get_obj_bpool(obj, 0);
     if (pool == (xfat_bpool_t*)0) {
         return FS_ERR_PARAM;
     }
 
+    // ĻΪͷлʱż
+    pool->next = (xfat_bpool_t*)0;
+    pool->disk = (obj->type == XFAT_OBJ_DISK) ? to_type(obj, xdisk_t) : (xdisk_t*)0;
+
+    // ȱʡʹLRU
+    pool->policy = XFAT_BUF_POLICY_LRU;
+    pool->ops = &bpool_lru_ops;
+    pool->pin_count = 0;
+    pool->dirty_count = 0;
+    pool->dirty_expire = XFAT_BUF_DIRTY_EXPIRE;
+    pool->dirty_ratio = XFAT_BUF_DIRTY_RATIO;
+    pool->ra_next = 0;
+    pool->ra_window = 0;
+    memset(&pool->stat, 0, sizeof(pool->stat));
+
     if (buf_count == 0) {
         pool->first = pool->last = (xfat_buf_t*)0;
         pool->size = 0;
+        pool->hash_tbl = (xfat_buf_t **)0;
+        pool->hash_mask = 0;
+        bpool_reset_policy(pool);
         return FS_ERR_OK;
     }
 
+    // ϣСȡ2ݣͰ
+    for (hash_size = 1; (hash_size << 1) <= buf_count; hash_size <<= 1) {}
+    for (i = 0; i < hash_size; i++) {
+        hash_tbl[i] = (xfat_buf_t *)0;
+    }
+    pool->hash_tbl = hash_tbl;
+    pool->hash_mask = hash_size - 1;
+
     // ͷ巨
     buf = (xfat_buf_t*)buf_start++;
     buf->pre = buf->next = buf;
-    buf->buf = sector_buf_start;
+    buf->buf = buf->data = sector_buf_start;
+    buf->sector_no = 0;
+    buf->flags = XFAT_BUF_STATE_FREE;
+    buf->ref = 0;
+    buf->hash_next = (xfat_buf_t*)0;
+    buf->pool = pool;
     pool->first = pool->last = buf;
-    sector_buf_start += sector_size;
+    sector_buf_start += stride;
 
-    for (i = 1; i < buf_count; i++, sector_buf_start += sector_size) {
+    for (i = 1; i < buf_count; i++, sector_buf_start += stride) {
         xfat_buf_t * buf = buf_start++;
         buf->next = pool->first;
         buf->pre = pool->first->pre;
@@ -187,60 +641,281 @@ xfat_err_t xfat_bpool_init(xfat_obj_t* obj, u32_t sector_size, u8_t* buffer, u32
         pool->first = buf;
 
         buf->sector_no = 0;
-        buf->buf = sector_buf_start;
+        buf->buf = buf->data = sector_buf_start;
         buf->flags = XFAT_BUF_STATE_FREE;
+        buf->ref = 0;
+        buf->hash_next = (xfat_buf_t*)0;
+        buf->pool = pool;
     }
 
     pool->size = buf_count;
+    bpool_reset_policy(pool);
+
+    if (obj->type != XFAT_OBJ_DISK) {
+        xdisk_t* disk = get_obj_disk(obj);
+
+        pool->disk = disk;
+        pool->next = disk->bpool.next;
+        disk->bpool.next = pool;
+    }
     return FS_ERR_OK;
 }
 
 /**
- * Ի巽ʽȡ̵ָ
- * @param disk
- * @param buf
- * @param sector_no
+ * objص滻ԣѻݱ
+ * µxfat_bpool_init󣬲ԻָΪȱʡLRU
+ * @param obj ̡ļ
+ * @param policy 滻
  * @return
  */
-xfat_err_t xfat_bpool_read_sector(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no) {
-    xfat_err_t err;
-    xfat_buf_t* r_buf = (xfat_buf_t*)0;
-    int need_read = 0;
-
-    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+xfat_err_t xfat_bpool_set_policy(xfat_obj_t* obj, xfat_buf_policy_t policy) {
+    xfat_bpool_t* pool = get_obj_bpool(obj, 0);
     if (pool == (xfat_bpool_t*)0) {
-        return FS_ERR_OK;
+        return FS_ERR_PARAM;
     }
 
-    err = bpool_find_buf(pool, sector_no, &r_buf);
-    if (err < 0) {
-        return err;
+    switch (policy) {
+    case XFAT_BUF_POLICY_LRU:
+        pool->ops = &bpool_lru_ops;
+        break;
+    case XFAT_BUF_POLICY_CLOCK:
+        pool->ops = &bpool_clock_ops;
+        break;
+    case XFAT_BUF_POLICY_2Q:
+        pool->ops = &bpool_2q_ops;
+        break;
+    default:
+        return FS_ERR_PARAM;
     }
 
-    if ((sector_no == r_buf->sector_no) && (xfat_buf_state(r_buf) != XFAT_BUF_STATE_FREE)) {
-        *buf = r_buf;
-        return FS_ERR_OK;
-    }
+    pool->policy = policy;
+    bpool_reset_policy(pool);
+    return FS_ERR_OK;
+}
 
-    // ͬ
-    switch (xfat_buf_state(r_buf)) {
-    case XFAT_BUF_STATE_FREE:
-    case XFAT_BUF_STATE_CLEAN:
-        break;
-    case XFAT_BUF_STATE_DIRTY:
-        err = xdisk_write_sector(get_obj_disk(obj), r_buf->buf, r_buf->sector_no, 1);
-        if (err < 0) {
-            return err;
+/**
+ * һĻ׷ӵɢ/ۼУһڴʱֱӺϲ
+ * @param vec
+ * @param vec_count еĶ
+ * @param buffer
+ * @param sector_size
+ * @return ׷ӺĶʱ0
+ */
+static u32_t bpool_vec_add(xdisk_vec_t* vec, u32_t vec_count, u8_t* buffer, u32_t sector_size) {
+    if (vec_count > 0) {
+        xdisk_vec_t* last = vec + vec_count - 1;
+
+        if (last->buffer + last->count * sector_size == buffer) {
+            last->count++;
+            return vec_count;
         }
     }
 
-    err = xdisk_read_sector(get_obj_disk(obj), r_buf->buf, sector_no, 1);
+    if (vec_count >= BPOOL_VEC_MAX) {
+        return 0;
+    }
+
+    vec[vec_count].buffer = buffer;
+    vec[vec_count].count = 1;
+    return vec_count + 1;
+}
+
+/**
+ * 㱾δʱҪԤ
+ * δеϴζȡʱΪ˳ʣÿνԤڼӱԤ
+ * @param pool
+ * @param disk
+ * @param sector_no δе
+ * @return
+ */
+static u32_t bpool_ra_count(xfat_bpool_t* pool, xdisk_t* disk, u32_t sector_no) {
+    u32_t max_count = XFAT_BUF_FLUSH_SIZE / disk->sector_size - 1;
+
+    if (sector_no != pool->ra_next) {
+        pool->ra_window = 0;
+        return 0;
+    }
+
+    // ռһĻ棬
+    if (max_count > pool->size / 2) {
+        max_count = pool->size / 2;
+    }
+
+    pool->ra_window = pool->ra_window ? pool->ra_window * 2 : XFAT_BUF_RA_MIN;
+    if (pool->ra_window > max_count) {
+        pool->ra_window = max_count;
+    }
+
+    // ̷ܳΧ
+    if (sector_no + 2 >= disk->total_sector) {
+        return 0;
+    } else if (sector_no + 1 + pool->ra_window >= disk->total_sector) {
+        return disk->total_sector - sector_no - 2;
+    }
+    return pool->ra_window;
+}
+
+/**
+ * ȡͬʱԤ
+ * ͨһηɢֱӶ֧첽ʱͬʱύ
+ * @param pool
+ * @param disk
+ * @param buf sector_noĻ
+ * @param sector_no ȡ
+ * @param ra_count Ԥ
+ * @return
+ */
+static xfat_err_t bpool_read_ahead(xfat_bpool_t* pool, xdisk_t* disk, xfat_buf_t* buf, u32_t sector_no, u32_t ra_count) {
+    xfat_err_t err;
+    xfat_buf_t* list = (xfat_buf_t*)0, ** tail = &list;
+    xfat_buf_t* curr_buf;
+    xdisk_vec_t vec[BPOOL_VEC_MAX];
+    u32_t vec_count;
+    u32_t count = 1;
+
+    // ѡԤõĿ飬ʱ̶ⱻѡ
+    // ѻʱֹͣͬʱֻʹдĿ
+    buf->ref++;
+    vec_count = bpool_vec_add(vec, 0, buf->buf, disk->sector_size);
+    while (count <= ra_count) {
+        if (bpool_disk_find(pool, sector_no + count) != (xfat_buf_t*)0) {
+            break;
+        }
+
+        curr_buf = pool->ops->victim(pool);
+        if ((curr_buf == (xfat_buf_t*)0) || (xfat_buf_state(curr_buf) == XFAT_BUF_STATE_DIRTY)) {
+            break;
+        }
+
+        if (xfat_buf_state(curr_buf) != XFAT_BUF_STATE_FREE) {
+            pool->stat.evict_count++;
+        }
+
+        bpool_unmap_buf(curr_buf, 0);
+        vec_count = bpool_vec_add(vec, vec_count, curr_buf->buf, disk->sector_size);
+
+        curr_buf->ref++;
+        curr_buf->io_next = (xfat_buf_t*)0;
+        *tail = curr_buf;
+        tail = &curr_buf->io_next;
+        count++;
+    }
+
+    err = xdisk_read_sector_v(disk, vec, vec_count, sector_no);
+
+    // ʧʱݿѱָǣٱ
+    buf->ref--;
+    if (err >= 0) {
+        bpool_rehash_buf(pool, buf, sector_no);
+        xfat_buf_set_state(buf, XFAT_BUF_STATE_CLEAN);
+        pool->ops->load(pool, buf);
+    } else {
+        bpool_free_buf(pool, buf);
+    }
+
+    for (curr_buf = list; curr_buf != (xfat_buf_t*)0; curr_buf = curr_buf->io_next) {
+        curr_buf->ref--;
+        if (err >= 0) {
+            bpool_rehash_buf(pool, curr_buf, ++sector_no);
+            xfat_buf_set_state(curr_buf, XFAT_BUF_STATE_CLEAN);
+            curr_buf->flags |= XFAT_BUF_RA;
+            pool->ops->load(pool, curr_buf);
+        } else {
+            bpool_free_buf(pool, curr_buf);
+        }
+    }
     if (err < 0) {
         return err;
     }
 
+    if (count > 1) {
+        pool->stat.ra.read_count++;
+        pool->stat.ra.sector_count += count - 1;
+    }
+    pool->ra_next = sector_no + 1;
+    return FS_ERR_OK;
+}
+
+/**
+ * Ի巽ʽȡ̵ָ
+ * ⵽˳ʱ˳Ԥ
+ * @param disk
+ * @param buf
+ * @param sector_no
+ * @return
+ */
+xfat_err_t xfat_bpool_read_sector(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no) {
+    xfat_err_t err;
+    xfat_buf_t* r_buf = (xfat_buf_t*)0;
+    xdisk_t* disk = get_obj_disk(obj);
+    u32_t ra_count;
+
+    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+    if (pool == (xfat_bpool_t*)0) {
+        return FS_ERR_OK;
+    }
+
+    err = bpool_find_buf(pool, sector_no, &r_buf);
+    if (err < 0) {
+        return err;
+    }
+
+    if ((sector_no == r_buf->sector_no) && (xfat_buf_state(r_buf) != XFAT_BUF_STATE_FREE)) {
+        *buf = r_buf;
+        return FS_ERR_OK;
+    }
+
+    // ͬ
+    switch (xfat_buf_state(r_buf)) {
+    case XFAT_BUF_STATE_FREE:
+    case XFAT_BUF_STATE_CLEAN:
+        break;
+    case XFAT_BUF_STATE_DIRTY:
+        err = xdisk_write_sector(disk, r_buf->buf, r_buf->sector_no, 1);
+        if (err < 0) {
+            return err;
+        }
+        xfat_buf_set_state(r_buf, XFAT_BUF_STATE_CLEAN);
+        pool->stat.write_back_count++;
+    }
+
+    // ֧ӳʱֱӳʡȥʱҲԤ
+    if (disk->driver->map_sector) {
+        u8_t* addr;
+
+        bpool_unmap_buf(r_buf, 0);
+        err = xdisk_map_sector(disk, sector_no, 1, &addr);
+        if (err >= 0) {
+            bpool_rehash_buf(pool, r_buf, sector_no);
+            r_buf->buf = addr;
+            r_buf->flags |= XFAT_BUF_MAPPED;
+            xfat_buf_set_state(r_buf, XFAT_BUF_STATE_CLEAN);
+            pool->ops->load(pool, r_buf);
+            *buf = r_buf;
+            return FS_ERR_OK;
+        }
+    }
+
+    ra_count = bpool_ra_count(pool, disk, sector_no);
+    if (ra_count > 0) {
+        err = bpool_read_ahead(pool, disk, r_buf, sector_no, ra_count);
+        if (err < 0) {
+            return err;
+        }
+
+        *buf = r_buf;
+        return FS_ERR_OK;
+    }
+
+    err = xdisk_read_sector(disk, r_buf->buf, sector_no, 1);
+    if (err < 0) {
+        return err;
+    }
+
+    bpool_rehash_buf(pool, r_buf, sector_no);
     xfat_buf_set_state(r_buf, XFAT_BUF_STATE_CLEAN);
-    r_buf->sector_no = sector_no;
+    pool->ops->load(pool, r_buf);
+    pool->ra_next = sector_no + 1;
     *buf = r_buf;
     return FS_ERR_OK;
 }
@@ -266,7 +941,9 @@ xfat_err_t xfat_bpool_alloc(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no)
         return err;
     }
 
+    // õĿ鳣߸дʹĴ洢
     if ((sector_no == r_buf->sector_no) && (xfat_buf_state(r_buf) != XFAT_BUF_STATE_FREE)) {
+        bpool_unmap_buf(r_buf, 1);
         *buf = r_buf;
         return FS_ERR_OK;
     }
@@ -281,14 +958,111 @@ xfat_err_t xfat_bpool_alloc(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no)
         if (err < 0) {
             return err;
         }
+        pool->stat.write_back_count++;
     }
 
+    bpool_unmap_buf(r_buf, 0);
+    bpool_rehash_buf(pool, r_buf, sector_no);
     xfat_buf_set_state(r_buf, XFAT_BUF_STATE_CLEAN);
-    r_buf->sector_no = sector_no;
+    pool->ops->load(pool, r_buf);
     *buf = r_buf;
     return FS_ERR_OK;
 }
 
+/**
+ * Ƿѻڴ̵ĳУȡ̣ҲӰ滻˳
+ * @param obj
+ * @param buf ҵĻ
+ * @param sector_no
+ * @return δʱFS_ERR_NONE
+ */
+xfat_err_t xfat_bpool_find(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no) {
+    xfat_buf_t* r_buf;
+
+    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+    if (pool == (xfat_bpool_t*)0) {
+        return FS_ERR_NONE;
+    }
+
+    r_buf = bpool_disk_find(pool, sector_no);
+    if (r_buf == (xfat_buf_t*)0) {
+        return FS_ERR_NONE;
+    }
+
+    *buf = r_buf;
+    return FS_ERR_OK;
+}
+
+/**
+ * ̶ס飬xfat_bpool_put_buf֮ǰÿ鲻ᱻ滻ɿλʹ
+ * Ҫһδ̶Ŀ鹩ʹãԻ̫Сʱ̶ʧܣ¶ȡ
+ * @param obj
+ * @param buf ѶȡõĻ
+ * @return
+ */
+xfat_err_t xfat_bpool_get_buf(xfat_obj_t* obj, xfat_buf_t* buf) {
+    xfat_bpool_t* pool = buf->pool;       // ڴϵ
+
+    if (buf->ref == 0) {
+        if (pool->pin_count + 1 >= pool->size) {
+            return FS_ERR_NO_BUFFER;
+        }
+        pool->pin_count++;
+    }
+
+    buf->ref++;
+    return FS_ERR_OK;
+}
+
+/**
+ * ͷxfat_bpool_get_buf̶Ļ
+ * @param obj
+ * @param buf
+ * @return
+ */
+xfat_err_t xfat_bpool_put_buf(xfat_obj_t* obj, xfat_buf_t* buf) {
+    xfat_bpool_t* pool = buf->pool;
+    if (buf->ref == 0) {
+        return FS_ERR_PARAM;
+    }
+
+    if (--buf->ref == 0) {
+        pool->pin_count--;
+    }
+    return FS_ERR_OK;
+}
+
+/**
+ * ȡobjûصͳϢ
+ * @param obj
+ * @param stat
+ * @return
+ */
+xfat_err_t xfat_bpool_stat(xfat_obj_t* obj, xfat_bpool_stat_t* stat) {
+    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+    if (pool == (xfat_bpool_t*)0) {
+        return FS_ERR_PARAM;
+    }
+
+    *stat = pool->stat;
+    return FS_ERR_OK;
+}
+
+/**
+ * objûصͳϢ
+ * @param obj
+ * @return
+ */
+xfat_err_t xfat_bpool_reset_stat(xfat_obj_t* obj) {
+    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+    if (pool == (xfat_bpool_t*)0) {
+        return FS_ERR_PARAM;
+    }
+
+    memset(&pool->stat, 0, sizeof(pool->stat));
+    return FS_ERR_OK;
+}
+
 /**
  * Ի巽ʽдȡ̵ָ
  * @param disk
@@ -299,6 +1073,11 @@ xfat_err_t xfat_bpool_alloc(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no)
 xfat_err_t xfat_bpool_write_sector(xfat_obj_t* obj, xfat_buf_t* buf, u8_t is_through) {
     xfat_err_t err = FS_ERR_OK;
 
+    // ߿ֱ޸sector_noдͬ
+    if ((xfat_buf_state(buf) == XFAT_BUF_STATE_FREE) || (buf->sector_no != buf->hash_no)) {
+        bpool_rehash_buf(buf->pool, buf, buf->sector_no);
+    }
+
     if (is_through) {
         err = xdisk_write_sector(get_obj_disk(obj), buf->buf, buf->sector_no, 1);
         if (err < 0) {
@@ -312,114 +1091,422 @@ xfat_err_t xfat_bpool_write_sector(xfat_obj_t* obj, xfat_buf_t* buf, u8_t is_thr
 }
 
 /**
- * 뻺ݿ
- * @param disk
+ * io_nextӵĻ飬Žй鲢
+ * @param list
+ * @return ͷ
+ */
+static xfat_buf_t* bpool_sort_bufs(xfat_buf_t* list) {
+    xfat_buf_t* slow, * fast, * right;
+    xfat_buf_t* head = (xfat_buf_t*)0, ** tail = &head;
+
+    if ((list == (xfat_buf_t*)0) || (list->io_next == (xfat_buf_t*)0)) {
+        return list;
+    }
+
+    // ָ뽫ֳ룬ֱ
+    slow = list;
+    fast = list->io_next;
+    while ((fast != (xfat_buf_t*)0) && (fast->io_next != (xfat_buf_t*)0)) {
+        slow = slow->io_next;
+        fast = fast->io_next->io_next;
+    }
+    right = slow->io_next;
+    slow->io_next = (xfat_buf_t*)0;
+
+    list = bpool_sort_bufs(list);
+    right = bpool_sort_bufs(right);
+
+    // ϲ
+    while ((list != (xfat_buf_t*)0) && (right != (xfat_buf_t*)0)) {
+        if (list->sector_no <= right->sector_no) {
+            *tail = list;
+            list = list->io_next;
+        } else {
+            *tail = right;
+            right = right->io_next;
+        }
+        tail = &(*tail)->io_next;
+    }
+    *tail = (list != (xfat_buf_t*)0) ? list : right;
+    return head;
+}
+
+/**
+ * ռָΧڵ飬io_next
+ * @param pool
+ * @param start_sector
+ * @param end_sector
  * @return
  */
-xfat_err_t xfat_bpool_flush(xfat_obj_t* obj) {
-    xfat_err_t err;
+static xfat_buf_t* bpool_collect_dirty(xfat_bpool_t* pool, u32_t start_sector, u32_t end_sector) {
+    xfat_buf_t* list = (xfat_buf_t*)0;
     xfat_buf_t* curr_buf;
-    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
-    u32_t size = pool->size;
+    u32_t size;
 
-    if (pool == (xfat_bpool_t*)0) {
-        return FS_ERR_PARAM;
+    // ΧСʱӺǰϣͷΪ
+    if (end_sector - start_sector < pool->size) {
+        u32_t sector = end_sector + 1;
+
+        while (sector-- > start_sector) {
+            curr_buf = bpool_hash_find(pool, sector);
+            if ((curr_buf != (xfat_buf_t*)0) && (xfat_buf_state(curr_buf) == XFAT_BUF_STATE_DIRTY)) {
+                curr_buf->io_next = list;
+                list = curr_buf;
+            }
+        }
+        return list;
     }
 
+    // 
+    size = pool->size;
     curr_buf = pool->first;
     while (size--) {
-        switch (xfat_buf_state(curr_buf)) {
-        case XFAT_BUF_STATE_FREE:
-        case XFAT_BUF_STATE_CLEAN:
-            break;
-        case XFAT_BUF_STATE_DIRTY:
-            err = xdisk_write_sector(get_obj_disk(obj), curr_buf->buf, curr_buf->sector_no, 1);
-            if (err < 0) {
-                return err;
+        if ((xfat_buf_state(curr_buf) == XFAT_BUF_STATE_DIRTY)
+            && (curr_buf->sector_no >= start_sector) && (curr_buf->sector_no <= end_sector)) {
+            curr_buf->io_next = list;
+            list = curr_buf;
+        }
+        curr_buf = curr_buf->next;
+    }
+
+    return bpool_sort_bufs(list);
+}
+
+/**
+ * д̣Ŀͨһξۼд
+ * ֧첽ʱηֱύصһддһ
+ * @param disk
+ * @param list
+ * @param reason дԭ򣬽ͳ
+ * @return
+ */
+static xfat_err_t bpool_write_bufs(xdisk_t* disk, xfat_buf_t* list, int reason) {
+    u8_t is_async = xdisk_is_async(disk);
+    xfat_buf_t* curr_list = list;
+    xfat_buf_t* curr_buf;
+    xfat_err_t err = FS_ERR_OK, io_err;
+
+    while (curr_list != (xfat_buf_t*)0) {
+        xdisk_vec_t vec[BPOOL_VEC_MAX];
+        u32_t vec_count;
+
+        // ҳһΣֱɢ/ۼ
+        curr_buf = curr_list;
+        vec_count = bpool_vec_add(vec, 0, curr_buf->buf, disk->sector_size);
+        while ((curr_buf->io_next != (xfat_buf_t*)0) && (curr_buf->io_next->sector_no == curr_buf->sector_no + 1)) {
+            u32_t next_count = bpool_vec_add(vec, vec_count, curr_buf->io_next->buf, disk->sector_size);
+            if (next_count == 0) {
+                break;
             }
-            xfat_buf_set_state(curr_buf, XFAT_BUF_STATE_CLEAN);
+
+            vec_count = next_count;
+            curr_buf = curr_buf->io_next;
+        }
+
+        if (is_async) {
+            u32_t sector_no = curr_list->sector_no;
+            u32_t i;
+
+            for (i = 0; (i < vec_count) && (err >= 0); i++) {
+                err = xdisk_submit_write(disk, vec[i].buffer, sector_no, vec[i].count);
+                sector_no += vec[i].count;
+            }
+        } else {
+            err = xdisk_write_sector_v(disk, vec, vec_count, curr_list->sector_no);
+        }
+        if (err < 0) {
             break;
         }
 
-        curr_buf = curr_buf->next;
+        curr_list = curr_buf->io_next;
+    }
+
+    // ȫдȷЩѻдʱп鱣Ϊ࣬´д
+    io_err = xdisk_wait_io(disk);
+    if (err >= 0) {
+        err = io_err;
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    for (curr_buf = list; curr_buf != (xfat_buf_t*)0; curr_buf = curr_buf->io_next) {
+        xfat_buf_set_state(curr_buf, XFAT_BUF_STATE_CLEAN);
+        switch (reason) {
+        case BPOOL_WRITE_FORCE:
+            curr_buf->pool->stat.force_flush_count++;
+            break;
+        case BPOOL_WRITE_TICK:
+            curr_buf->pool->stat.tick_flush_count++;
+            break;
+        default:
+            curr_buf->pool->stat.flush_count++;
+            break;
+        }
     }
 
     return FS_ERR_OK;
 }
+
 /**
- * ָΧڵĻд
+ * ռлָΧڵ飬io_next
+ * @param disk
+ * @param start_sector
+ * @param end_sector
+ * @return
+ */
+static xfat_buf_t* bpool_collect_disk_dirty(xdisk_t* disk, u32_t start_sector, u32_t end_sector) {
+    xfat_buf_t* list = (xfat_buf_t*)0, ** tail = &list;
+    xfat_bpool_t* pool;
+    int pool_count = 0;
+
+    for (pool = &disk->bpool; pool != (xfat_bpool_t*)0; pool = pool->next) {
+        if (pool->size == 0) {
+            continue;
+        }
+
+        *tail = bpool_collect_dirty(pool, start_sector, end_sector);
+        if (*tail != (xfat_buf_t*)0) {
+            pool_count++;
+        }
+        while (*tail != (xfat_buf_t*)0) {
+            tail = &(*tail)->io_next;
+        }
+    }
+
+    // صĿһ
+    return (pool_count > 1) ? bpool_sort_bufs(list) : list;
+}
+
+/**
+ * де
+ * Դ̶ԻдлأԷļֻдõĻ
+ * @param disk
+ * @return
+ */
+xfat_err_t xfat_bpool_flush(xfat_obj_t* obj) {
+    xfat_buf_t* list;
+    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
+
+    if (pool == (xfat_bpool_t*)0) {
+        return FS_ERR_PARAM;
+    }
+
+    if (obj->type == XFAT_OBJ_DISK) {
+        list = bpool_collect_disk_dirty(get_obj_disk(obj), 0, 0xFFFFFFFF);
+    } else if (pool->size > 0) {
+        list = bpool_collect_dirty(pool, 0, 0xFFFFFFFF);
+    } else {
+        return FS_ERR_OK;
+    }
+    return bpool_write_bufs(get_obj_disk(obj), list, BPOOL_WRITE_FLUSH);
+}
+
+/**
+ * ָΧڵĻд̣леӦд
  * @param obj
  * @param start_sector
  * @param count
  * @return
  */
 xfat_err_t xfat_bpool_flush_sectors(xfat_obj_t* obj, u32_t start_sector, u32_t count) {
+    xfat_buf_t* list;
+    xdisk_t* disk = get_obj_disk(obj);
+
+    if (count == 0) {
+        return FS_ERR_OK;
+    }
+
+    list = bpool_collect_disk_dirty(disk, start_sector, start_sector + count - 1);
+    return bpool_write_bufs(disk, list, BPOOL_WRITE_FORCE);
+}
+
+/**
+ * дobjе飬ӴϽ˺󻺳Ϊ
+ * ԭڴɵãļرաжؼǰ
+ * @param obj
+ * @return
+ */
+xfat_err_t xfat_bpool_release(xfat_obj_t* obj) {
     xfat_err_t err;
+    xfat_bpool_t** pp;
     xfat_buf_t* curr_buf;
-    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
-    u32_t size = pool->size;
-    u32_t end_sector = start_sector + count - 1;
+    u32_t size;
+    xfat_bpool_t* pool = get_obj_bpool(obj, 0);
 
-    if (pool == (xfat_bpool_t*)0) {
+    // Ļͷ̹رնͷ
+    if ((pool == (xfat_bpool_t*)0) || (obj->type == XFAT_OBJ_DISK)) {
         return FS_ERR_PARAM;
     }
 
-    curr_buf = pool->first;
-    while (size--) {
-        switch (xfat_buf_state(curr_buf)) {
-        case XFAT_BUF_STATE_FREE:
-        case XFAT_BUF_STATE_CLEAN:
-            break;
-        case XFAT_BUF_STATE_DIRTY:
-            if ((curr_buf->sector_no >= start_sector) && (curr_buf->sector_no <= end_sector)) {
-                err = xdisk_write_sector(get_obj_disk(obj), curr_buf->buf, curr_buf->sector_no, 1);
-                if (err < 0) {
-                    return err;
-                }
-                xfat_buf_set_state(curr_buf, XFAT_BUF_STATE_CLEAN);
-            }
+    if (pool->size == 0) {
+        return FS_ERR_OK;
+    }
+
+    err = bpool_write_bufs(pool->disk, bpool_collect_dirty(pool, 0, 0xFFFFFFFF), BPOOL_WRITE_FLUSH);
+    if (err < 0) {
+        return err;
+    }
+
+    for (pp = &pool->disk->bpool.next; *pp != (xfat_bpool_t*)0; pp = &(*pp)->next) {
+        if (*pp == pool) {
+            *pp = pool->next;
             break;
         }
+    }
 
-        curr_buf = curr_buf->next;
+    for (curr_buf = pool->first, size = pool->size; size--; curr_buf = curr_buf->next) {
+        bpool_unmap_buf(curr_buf, 0);
     }
 
-    return FS_ERR_OK;
+    return xfat_bpool_init(obj, 0, (u8_t*)0, 0, 0);
 }
 
 /**
- * ָΧڵĻ棬еĻ潫ֱӶ
- * @param obj
+ * ָΧڵĻ
+ * @param pool
  * @param start_sector
- * @param count
- * @return
+ * @param end_sector
  */
-xfat_err_t xfat_bpool_invalid_sectors(xfat_obj_t* obj, u32_t start_sector, u32_t count) {
+static void bpool_invalid_sectors(xfat_bpool_t* pool, u32_t start_sector, u32_t end_sector) {
     xfat_buf_t* curr_buf;
-    xfat_bpool_t* pool = get_obj_bpool(obj, 1);
-    u32_t size = pool->size;
-    u32_t end_sector = start_sector + count - 1;
+    u32_t size;
 
-    if (pool == (xfat_bpool_t*)0) {
-        return FS_ERR_PARAM;
+    // ΧСʱϣ
+    if (end_sector - start_sector < pool->size) {
+        u32_t sector;
+
+        for (sector = start_sector; sector <= end_sector; sector++) {
+            curr_buf = bpool_hash_find(pool, sector);
+            if (curr_buf != (xfat_buf_t*)0) {
+                bpool_free_buf(pool, curr_buf);
+                pool->stat.invalid_count++;
+            }
+        }
+        return;
     }
 
+    // ͷŵĿᱻƵβȼº̽
+    size = pool->size;
     curr_buf = pool->first;
     while (size--) {
+        xfat_buf_t* next_buf = curr_buf->next;
+
         switch (xfat_buf_state(curr_buf)) {
             case XFAT_BUF_STATE_FREE:
                 break;
             case XFAT_BUF_STATE_CLEAN:
             case XFAT_BUF_STATE_DIRTY:
                 if ((curr_buf->sector_no >= start_sector) && (curr_buf->sector_no <= end_sector)) {
-                    xfat_buf_set_state(curr_buf, XFAT_BUF_STATE_FREE);
+                    bpool_free_buf(pool, curr_buf);
+                    pool->stat.invalid_count++;
                 }
                 break;
         }
 
-        curr_buf = curr_buf->next;
+        curr_buf = next_buf;
+    }
+}
+
+/**
+ * ָΧڵĻ棬еĻ潫ֱӶ
+ * леӦᱻ
+ * @param obj
+ * @param start_sector
+ * @param count
+ * @return
+ */
+xfat_err_t xfat_bpool_invalid_sectors(xfat_obj_t* obj, u32_t start_sector, u32_t count) {
+    xfat_bpool_t* pool;
+
+    if (count == 0) {
+        return FS_ERR_OK;
+    }
+
+    for (pool = &get_obj_disk(obj)->bpool; pool != (xfat_bpool_t*)0; pool = pool->next) {
+        if (pool->size > 0) {
+            bpool_invalid_sectors(pool, start_sector, start_sector + count - 1);
+        }
     }
 
     return FS_ERR_OK;
 }
 
+/**
+ * objصĶʱд
+ * @param obj
+ * @param dirty_expire ͣʱд0ʾʱд
+ * @param dirty_ratio ռȴﵽðٷֱʱдȫ飬0ʾд
+ * @return
+ */
+xfat_err_t xfat_bpool_set_writeback(xfat_obj_t* obj, u32_t dirty_expire, u32_t dirty_ratio) {
+    xfat_bpool_t* pool = get_obj_bpool(obj, 0);
+    if ((pool == (xfat_bpool_t*)0) || (dirty_ratio > 100)) {
+        return FS_ERR_PARAM;
+    }
+
+    pool->dirty_expire = dirty_expire;
+    pool->dirty_ratio = dirty_ratio;
+    return FS_ERR_OK;
+}
+
+/**
+ * ռбѳָʱĿ飬io_next
+ * @param pool
+ * @param now ǰʱ
+ * @param min_age ʱΪ0ʱռ
+ * @return
+ */
+static xfat_buf_t* bpool_collect_aged(xfat_bpool_t* pool, u32_t now, u32_t min_age) {
+    xfat_buf_t* list = (xfat_buf_t*)0;
+    xfat_buf_t* curr_buf = pool->first;
+    u32_t size = pool->size;
+
+    while (size--) {
+        if ((xfat_buf_state(curr_buf) == XFAT_BUF_STATE_DIRTY) && (now - curr_buf->dirty_tick >= min_age)) {
+            curr_buf->io_next = list;
+            list = curr_buf;
+        }
+        curr_buf = curr_buf->next;
+    }
+    return list;
+}
+
+/**
+ * ƽ̵Ļдʱӣдϸ趨ʱд
+ * ռȳֵĻػдȫ飬ֻдʱ飬пϲһд
+ * ӦԵãʹڿʱдڶдʱ滻رļŻд
+ * @param obj ̣ϵķļ
+ * @param elapsed ϴεþʱ䣬λdirty_expireͬ
+ * @return
+ */
+xfat_err_t xfat_bpool_tick(xfat_obj_t* obj, u32_t elapsed) {
+    xdisk_t* disk = get_obj_disk(obj);
+    xfat_buf_t* list = (xfat_buf_t*)0, ** tail = &list;
+    xfat_bpool_t* pool;
+
+    disk->bpool_tick += elapsed;
+
+    for (pool = &disk->bpool; pool != (xfat_bpool_t*)0; pool = pool->next) {
+        u32_t min_age;
+
+        if (pool->dirty_count == 0) {
+            continue;
+        }
+
+        if (pool->dirty_ratio && (pool->dirty_count * 100 >= pool->size * pool->dirty_ratio)) {
+            min_age = 0;
+        } else if (pool->dirty_expire) {
+            min_age = pool->dirty_expire;
+        } else {
+            continue;
+        }
+
+        *tail = bpool_collect_aged(pool, disk->bpool_tick, min_age);
+        while (*tail != (xfat_buf_t*)0) {
+            tail = &(*tail)->io_next;
+        }
+    }
+
+    return bpool_write_bufs(disk, bpool_sort_bufs(list), BPOOL_WRITE_TICK);
+}
@@ -14,42 +14,150 @@
 #define XFAT_BUF_STATE_CLEAN       (1 << 0)			// ɾδд
 #define XFAT_BUF_STATE_DIRTY       (2 << 0)			// ࣬Ѿдݣδд
 #define XFAT_BUF_STATE_MSK         (3 << 0)         // д״̬
+#define XFAT_BUF_REF               (1 << 2)         // CLOCKԣʹ
+#define XFAT_BUF_A1                (1 << 3)         // 2Qԣλö
+#define XFAT_BUF_RA                (1 << 4)         // Ԥõδʹ
+#define XFAT_BUF_MAPPED            (1 << 5)         // bufֱָӳĴ洢
+
+struct _xfat_bpool_t;
+struct _xdisk_t;
 
 /**
  * ̻
  */
 typedef struct _xfat_buf_t {
     u8_t * buf;                         // ݻ
+    u8_t * data;                        // ΪÿĴ洢ӳbufָָ˴
     u32_t sector_no;                    // 
     u32_t flags;                        // ر
+    u32_t ref;                          // ü0ʱÿ鱻̶ᱻ滻
+    u32_t dirty_tick;                   // ʱʱӵֵ
 
     struct _xfat_buf_t * next;
     struct _xfat_buf_t * pre;
+
+    u32_t hash_no;                      // ϣʱʹõ
+    struct _xfat_buf_t * hash_next;     // ͬһϣͰеһ
+    struct _xfat_buf_t * io_next;       // дʱʱ
+
+    struct _xfat_bpool_t * pool;        // Ļ
 }xfat_buf_t;
 
+#define XFAT_BUF_FLUSH_SIZE     (8 * 1024)  // Ԥֽͬʱϲдʱ
+#define XFAT_BUF_RA_MIN         2           // ⵽˳ʺ״Ԥ
+#define XFAT_BUF_DIRTY_EXPIRE   3000        // 鳬ʱ(xfat_bpool_tickʱ䵥λͬ)ʱд0ʾʱд
+#define XFAT_BUF_DIRTY_RATIO    50          // ռصİٷֱȴﵽֵʱʱдȫ飬0ʾд
+#define XFAT_BUF_ALIGN          4096        // Ҫʱ(O_DIRECT)ʼַĶֽ
+
 #define xfat_buf_state(buf)       (buf->flags & XFAT_BUF_STATE_MSK)
 
 void xfat_buf_set_state(xfat_buf_t * buf, u32_t state);
 
+/**
+ * 滻
+ */
+typedef enum _xfat_buf_policy_t {
+    XFAT_BUF_POLICY_LRU,                // ʹãʱͷ
+    XFAT_BUF_POLICY_CLOCK,              // ʱ㷨ʱֻ÷λ
+    XFAT_BUF_POLICY_2Q,                 // ¿ȽöУٴвŽУ˳ɨ費ȵ
+}xfat_buf_policy_t;
+
+/**
+ * Ԥͳ
+ */
+typedef struct _xfat_ra_stat_t {
+    u32_t read_count;                   // ԤĴ
+    u32_t sector_count;                 // Ԥ
+    u32_t used_count;                   // Ԥе
+    u32_t wasted_count;                 // Ԥδʼ滻
+}xfat_ra_stat_t;
+
+/**
+ * ͳƣȷʵĻС
+ */
+typedef struct _xfat_bpool_stat_t {
+    u32_t hit_count;                    // ддеĿ
+    u32_t miss_count;                   // δд
+    u32_t evict_count;                  // 滻ЧĴ
+    u32_t write_back_count;             // 滻ʱдĴ
+    u32_t flush_count;                  // дʱд
+    u32_t force_flush_count;            // xfat_bpool_flush_sectorsǿƻд
+    u32_t invalid_count;                // xfat_bpool_invalid_sectorsĿ
+    u32_t tick_flush_count;             // xfat_bpool_tickʱд
+    xfat_ra_stat_t ra;                  // Ԥͳ
+}xfat_bpool_stat_t;
+
+/**
+ * 滻ԵĻصӿ
+ */
+typedef struct _xfat_bpool_ops_t {
+    void (*hit)(struct _xfat_bpool_t * pool, xfat_buf_t * buf);        // л
+    xfat_buf_t * (*victim)(struct _xfat_bpool_t * pool);              // ѡ滻Ŀ
+    void (*load)(struct _xfat_bpool_t * pool, xfat_buf_t * buf);       // 鱻
+    void (*free)(struct _xfat_bpool_t * pool, xfat_buf_t * buf);       // 鱻ͷ
+}xfat_bpool_ops_t;
+
 /**
  * ̻
+ * ΪΣfirstΪͷlastΪβпܷڱβ
+ * ̡ļԵĻضڴϣʱлأͬһֻһݻ棻
+ * δʱֻ滻еĿ飬ԸصĴСΪ߿ռõ
  */
 typedef struct _xfat_bpool_t {
     xfat_buf_t * first;
     xfat_buf_t * last;
     u32_t size;
+
+    xfat_buf_t ** hash_tbl;             // Ĺϣ
+    u32_t hash_mask;                    // ϣС-1СΪ2
+
+    xfat_buf_policy_t policy;           // 滻
+    const xfat_bpool_ops_t * ops;
+    xfat_buf_t * hand;                  // CLOCKԣʱָ
+    xfat_buf_t * a1_first;              // 2QԣöڱβΪһ
+    u32_t a1_count;                     // 2QԣöеĿ
+    u32_t a1_limit;                     // 2QԣöеĿ
+
+    u32_t pin_count;                    // ̶Ŀ
+
+    u32_t ra_next;                      // ˳ʱһδеӦΪ
+    u32_t ra_window;                    // ǰԤڵ
+    xfat_bpool_stat_t stat;             // ͳϢ
+
+    u32_t dirty_count;                  // 
+    u32_t dirty_expire;                 // ʱдͣʱ
+    u32_t dirty_ratio;                  // ʱдռȵޣٷֱ
+
+    struct _xdisk_t * disk;             // ڵĴ
+    struct _xfat_bpool_t * next;        // ͬһϵһأԴĻΪͷ
 }xfat_bpool_t;
 
-// ̻ռС
-#define XFAT_BUF_SIZE(sector_size, sector_nr)    ((sizeof(xfat_buf_t) + (sector_size)) * sector_nr)
+// ̻ռС㣺ṹ + ϣͰ + 
+#define XFAT_BUF_SIZE(sector_size, sector_nr)    ((sizeof(xfat_buf_t) + sizeof(xfat_buf_t *) + (sector_size)) * (sector_nr))
+
+// alignʱÿʵռõĿռ
+#define XFAT_BUF_STRIDE(sector_size, align)     ((align) ? (((sector_size) + (align) - 1) / (align) * (align)) : (sector_size))
+
+// alignʱĻռСӶʼַ
+#define XFAT_BUF_SIZE_ALIGN(sector_size, sector_nr, align)   \
+    ((sizeof(xfat_buf_t) + sizeof(xfat_buf_t *) + XFAT_BUF_STRIDE(sector_size, align)) * (sector_nr) + (align))
 
-xfat_err_t xfat_bpool_init(xfat_obj_t* obj, u32_t sector_size, u8_t * buffer, u32_t buf_size);
+xfat_err_t xfat_bpool_init(xfat_obj_t* obj, u32_t sector_size, u8_t * buffer, u32_t buf_size, u32_t align);
+xfat_err_t xfat_bpool_release(xfat_obj_t* obj);
+xfat_err_t xfat_bpool_set_policy(xfat_obj_t* obj, xfat_buf_policy_t policy);
 xfat_err_t xfat_bpool_read_sector(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no);
 xfat_err_t xfat_bpool_write_sector(xfat_obj_t* obj, xfat_buf_t* buf, u8_t is_through);
 xfat_err_t xfat_bpool_alloc(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no);
+xfat_err_t xfat_bpool_find(xfat_obj_t* obj, xfat_buf_t** buf, u32_t sector_no);
+xfat_err_t xfat_bpool_get_buf(xfat_obj_t* obj, xfat_buf_t* buf);
+xfat_err_t xfat_bpool_put_buf(xfat_obj_t* obj, xfat_buf_t* buf);
+xfat_err_t xfat_bpool_stat(xfat_obj_t* obj, xfat_bpool_stat_t * stat);
+xfat_err_t xfat_bpool_reset_stat(xfat_obj_t* obj);
 xfat_err_t xfat_bpool_flush(xfat_obj_t* obj);
 xfat_err_t xfat_bpool_flush_sectors(xfat_obj_t* obj, u32_t start_sector, u32_t count);
 xfat_err_t xfat_bpool_invalid_sectors(xfat_obj_t* obj, u32_t start_sector, u32_t count);
+xfat_err_t xfat_bpool_set_writeback(xfat_obj_t* obj, u32_t dirty_expire, u32_t dirty_ratio);
+xfat_err_t xfat_bpool_tick(xfat_obj_t* obj, u32_t elapsed);
 
 
 #endif //Xbuf_H